@@ -9,6 +9,7 @@
 #include <random>
 #include <iostream>
 #include <filesystem>
+#include <sys/resource.h>
 
 #include "logger.h"
 #include "sinks/effective_sink.h"
@@ -24,6 +25,18 @@ static std::shared_ptr<spdlog::logger> g_spdlog_async;
 static std::shared_ptr<logger::EffectiveSink> g_my_sink;
 static std::unique_ptr<logger::LogHandle> g_my_logger;
 
+static std::shared_ptr<logger::EffectiveSink> g_my_staging_sink;
+static std::unique_ptr<logger::LogHandle> g_my_staging_logger;
+
+// 不同压缩线程数的 Effective sink，下标为压缩线程数
+static constexpr int kCompressWorkers[] = {0, 1, 2, 4, 8};
+static std::shared_ptr<logger::EffectiveSink> g_compress_sinks[9];
+static std::unique_ptr<logger::LogHandle> g_compress_loggers[9];
+
+// 下标 0: CBC，压缩和加密各经过一个中间缓冲区；1: CTR，压缩直接输出到mmap并原地加密
+static std::shared_ptr<logger::EffectiveSink> g_copy_sinks[2];
+static std::unique_ptr<logger::LogHandle> g_copy_loggers[2];
+
 // 辅助函数：生成随机字符串
 std::string GenerateRandomString(int length) {
     static const char charset[] = "0123456789abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ";
@@ -74,6 +87,38 @@ void GlobalSetup() {
         g_my_sink = std::make_shared<logger::EffectiveSink>(conf);
         std::vector<std::shared_ptr<logger::Sink>> sinks = {g_my_sink};
         g_my_logger = std::make_unique<logger::LogHandle>(sinks.begin(), sinks.end());
+
+        // E. 初始化 Effective 暂存环模式 (每个线程独占一个环)
+        conf.dir = "logs/staging";
+        conf.prefix = "bench_staging";
+        conf.ring_size = logger::kilobytes(256);
+        g_my_staging_sink = std::make_shared<logger::EffectiveSink>(conf);
+        std::vector<std::shared_ptr<logger::Sink>> staging_sinks = {g_my_staging_sink};
+        g_my_staging_logger = std::make_unique<logger::LogHandle>(staging_sinks.begin(), staging_sinks.end());
+
+        // F. 初始化 Effective 并行压缩模式
+        for (int workers : kCompressWorkers) {
+            conf.dir = "logs/compress_" + std::to_string(workers);
+            conf.prefix = "bench_compress";
+            conf.ring_size = logger::kilobytes(1024);
+            conf.compress_workers = workers;
+            g_compress_sinks[workers] = std::make_shared<logger::EffectiveSink>(conf);
+            std::vector<std::shared_ptr<logger::Sink>> compress_sinks = {g_compress_sinks[workers]};
+            g_compress_loggers[workers] =
+                    std::make_unique<logger::LogHandle>(compress_sinks.begin(), compress_sinks.end());
+        }
+
+        // G. 初始化 Effective 拷贝路径对比
+        conf.ring_size = logger::kilobytes(0);
+        conf.compress_workers = 0;
+        for (int zero_copy = 0; zero_copy < 2; ++zero_copy) {
+            conf.dir = "logs/copy_" + std::to_string(zero_copy);
+            conf.prefix = "bench_copy";
+            conf.cipher_mode = zero_copy ? logger::crypt::CipherMode::kAesCtr : logger::crypt::CipherMode::kAesCbc;
+            g_copy_sinks[zero_copy] = std::make_shared<logger::EffectiveSink>(conf);
+            std::vector<std::shared_ptr<logger::Sink>> copy_sinks = {g_copy_sinks[zero_copy]};
+            g_copy_loggers[zero_copy] = std::make_unique<logger::LogHandle>(copy_sinks.begin(), copy_sinks.end());
+        }
     } catch (const std::exception& e) {
         std::cerr << "Init MyLogger Failed: " << e.what() << std::endl;
     }
@@ -106,6 +151,218 @@ static void BM_Effectivelog(benchmark::State& state) {
     }
 }
 
+static void BM_Effectivelog_Staging(benchmark::State& state) {
+    std::string msg = GenerateRandomString(state.range(0));
+    logger::SourceLocation loc{__FILE__, __LINE__, __FUNCTION__};
+
+    for (auto _ : state) {
+        g_my_staging_logger->Log(logger::LogLevel::kInfo, loc, msg);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 写入一批日志并等待全部压缩落盘，衡量后台压缩吞吐
+static void BM_Effectivelog_CompressWorkers(benchmark::State& state) {
+    constexpr int kRecordsPerIteration = 20000;
+    int workers = state.range(0);
+    std::string msg = "request finished, status=200, path=/api/v1/items, payload=" + GenerateRandomString(128);
+    logger::SourceLocation loc{__FILE__, __LINE__, __FUNCTION__};
+
+    for (auto _ : state) {
+        for (int i = 0; i < kRecordsPerIteration; ++i) {
+            g_compress_loggers[workers]->Log(logger::LogLevel::kInfo, loc, msg);
+        }
+        g_compress_sinks[workers]->Flush();
+    }
+    state.SetItemsProcessed(state.iterations() * kRecordsPerIteration);
+    state.SetBytesProcessed(state.iterations() * kRecordsPerIteration * msg.size());
+}
+
+// 单条日志从序列化到进入mmap的开销：CBC 路径每字节拷贝三次，CTR 路径只有压缩输出这一遍
+static void BM_Effectivelog_ZeroCopy(benchmark::State& state) {
+    int zero_copy = state.range(0);
+    std::string msg = GenerateRandomString(state.range(1));
+    logger::SourceLocation loc{__FILE__, __LINE__, __FUNCTION__};
+
+    for (auto _ : state) {
+        g_copy_loggers[zero_copy]->Log(logger::LogLevel::kInfo, loc, msg);
+    }
+    state.SetItemsProcessed(state.iterations());
+    state.SetBytesProcessed(state.iterations() * msg.size());
+}
+
+// 冷缓存段上的缺页次数：每轮新建sink，只统计写入期间的次缺页
+// 0: 默认 / 1: 预先缺页 / 2: 预先缺页 + 大页
+static void BM_Effectivelog_PageFaults(benchmark::State& state) {
+    constexpr int kRecordsPerIteration = 100000;
+    int mode = state.range(0);
+    std::string msg = "request finished, status=200, path=/api/v1/items, payload=" + GenerateRandomString(512);
+    logger::SourceLocation loc{__FILE__, __LINE__, __FUNCTION__};
+
+    logger::EffectiveSink::Config conf;
+    conf.dir = "logs/faults_" + std::to_string(mode);
+    conf.prefix = "bench_faults";
+    conf.pub_key =
+            "04827405069030E26A211C973C8710E6FBE79B5CAA364AC111FB171311902277537F8852EADD17EB339EB7CD0BA2490A58CDED2C70"
+            "2DFC1EFC7EDB544B869F039C";
+    conf.segment_size = logger::kilobytes(2048);
+    conf.cache_populate = mode >= 1;
+    conf.cache_huge_pages = mode >= 2;
+
+    long faults = 0;
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(conf.dir);
+        auto sink = std::make_shared<logger::EffectiveSink>(conf);
+        std::vector<std::shared_ptr<logger::Sink>> sinks = {sink};
+        logger::LogHandle handle(sinks.begin(), sinks.end());
+        struct rusage before;
+        getrusage(RUSAGE_SELF, &before);
+        state.ResumeTiming();
+
+        for (int i = 0; i < kRecordsPerIteration; ++i) {
+            handle.Log(logger::LogLevel::kInfo, loc, msg);
+        }
+
+        state.PauseTiming();
+        struct rusage after;
+        getrusage(RUSAGE_SELF, &after);
+        faults += after.ru_minflt - before.ru_minflt;
+        sink->Flush();
+        state.ResumeTiming();
+    }
+    state.SetItemsProcessed(state.iterations() * kRecordsPerIteration);
+    state.counters["faults_per_1M"] =
+            static_cast<double>(faults) * 1000000 / (static_cast<double>(state.iterations()) * kRecordsPerIteration);
+}
+
+// 段写满就阻塞等待落盘，吞吐受落盘速度限制：每轮新建sink，写入后 Flush 到全部落盘
+// 0: 落盘线程同步写入 / 1: 写线程 io_depth=4 / 2: io_uring io_depth=4
+static void BM_Effectivelog_FlushThroughput(benchmark::State& state) {
+    constexpr int kRecordsPerIteration = 100000;
+    int mode = state.range(0);
+    std::string msg = GenerateRandomString(1024);
+    logger::SourceLocation loc{__FILE__, __LINE__, __FUNCTION__};
+
+    logger::EffectiveSink::Config conf;
+    conf.dir = "logs/flush_" + std::to_string(mode);
+    conf.prefix = "bench_flush";
+    conf.pub_key =
+            "04827405069030E26A211C973C8710E6FBE79B5CAA364AC111FB171311902277537F8852EADD17EB339EB7CD0BA2490A58CDED2C70"
+            "2DFC1EFC7EDB544B869F039C";
+    conf.single_size = logger::megabytes(1024);
+    conf.total_size = logger::megabytes(4096);
+    conf.cache_segments = 8;
+    conf.segment_size = logger::kilobytes(256);
+    conf.full_policy = logger::EffectiveSink::FullPolicy::kBlock;
+    conf.io_depth = mode == 0 ? 0 : 4;
+    conf.io_backend = mode == 1 ? logger::FileWriter::Backend::kThread : logger::FileWriter::Backend::kUring;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(conf.dir);
+        auto sink = std::make_shared<logger::EffectiveSink>(conf);
+        std::vector<std::shared_ptr<logger::Sink>> sinks = {sink};
+        logger::LogHandle handle(sinks.begin(), sinks.end());
+        state.ResumeTiming();
+
+        for (int i = 0; i < kRecordsPerIteration; ++i) {
+            handle.Log(logger::LogLevel::kInfo, loc, msg);
+        }
+        sink->Flush();
+    }
+    state.SetItemsProcessed(state.iterations() * kRecordsPerIteration);
+    state.SetBytesProcessed(state.iterations() * kRecordsPerIteration * msg.size());
+}
+
+// 持久化策略对写入延迟的影响，1% 的日志是 error 级别
+// 0: kNone / 1: kAsync / 2: kSync / 3: kErrorSync，定期同步间隔 100ms
+static void BM_Effectivelog_Durability(benchmark::State& state) {
+    int mode = state.range(0);
+    std::string msg = GenerateRandomString(256);
+    logger::SourceLocation loc{__FILE__, __LINE__, __FUNCTION__};
+
+    logger::EffectiveSink::Config conf;
+    conf.dir = "logs/durability_" + std::to_string(mode);
+    conf.prefix = "bench_durability";
+    conf.pub_key =
+            "04827405069030E26A211C973C8710E6FBE79B5CAA364AC111FB171311902277537F8852EADD17EB339EB7CD0BA2490A58CDED2C70"
+            "2DFC1EFC7EDB544B869F039C";
+    conf.durability = static_cast<logger::EffectiveSink::Durability>(mode);
+    conf.sync_interval = std::chrono::milliseconds(100);
+    std::filesystem::remove_all(conf.dir);
+    auto sink = std::make_shared<logger::EffectiveSink>(conf);
+    std::vector<std::shared_ptr<logger::Sink>> sinks = {sink};
+    logger::LogHandle handle(sinks.begin(), sinks.end());
+
+    size_t count = 0;
+    for (auto _ : state) {
+        handle.Log(++count % 100 == 0 ? logger::LogLevel::kError : logger::LogLevel::kInfo, loc, msg);
+    }
+    sink->Flush();
+    state.SetItemsProcessed(state.iterations());
+}
+
+// 启动时遗留大量未落盘缓存 (上次崩溃退出)，从构造sink到第一条日志写入缓存的耗时
+// 参数为遗留缓存的总大小 MB，平均分布在各个缓存段中；恢复在落盘线程上进行，不计入耗时
+static void BM_Effectivelog_StartupRecovery(benchmark::State& state) {
+    constexpr uint32_t kSegments = 4;
+    size_t leftover_bytes = static_cast<size_t>(state.range(0)) * 1024 * 1024;
+    std::string msg = GenerateRandomString(256);
+    std::string filler = GenerateRandomString(1024 * 1024);
+    logger::SourceLocation loc{__FILE__, __LINE__, __FUNCTION__};
+
+    logger::EffectiveSink::Config conf;
+    conf.dir = "logs/startup_" + std::to_string(state.range(0));
+    conf.prefix = "bench_startup";
+    conf.pub_key =
+            "04827405069030E26A211C973C8710E6FBE79B5CAA364AC111FB171311902277537F8852EADD17EB339EB7CD0BA2490A58CDED2C70"
+            "2DFC1EFC7EDB544B869F039C";
+    conf.single_size = logger::megabytes(1024);
+    conf.total_size = logger::megabytes(4096);
+    conf.cache_segments = kSegments;
+
+    for (auto _ : state) {
+        state.PauseTiming();
+        std::filesystem::remove_all(conf.dir);
+        std::filesystem::create_directories(conf.dir);
+        for (uint32_t i = 0; i < kSegments && leftover_bytes > 0; ++i) {
+            logger::MMapHandle cache(conf.dir / ("cache_" + std::to_string(i)), leftover_bytes / kSegments);
+            for (size_t size = 0; size < leftover_bytes / kSegments; size += filler.size()) {
+                cache.Push(filler.data(), filler.size());
+            }
+        }
+        state.ResumeTiming();
+
+        std::vector<std::shared_ptr<logger::Sink>> sinks = {std::make_shared<logger::EffectiveSink>(conf)};
+        auto handle = std::make_unique<logger::LogHandle>(sinks.begin(), sinks.end());
+        handle->Log(logger::LogLevel::kInfo, loc, msg);
+
+        state.PauseTiming();
+        handle.reset();  // 析构时等待恢复和落盘完成，不计入耗时
+        sinks.clear();
+        state.ResumeTiming();
+    }
+}
+
+// 级别被过滤的调用点开销：0 为日志宏 (编译期的调用点描述) / 1 为每次构造 SourceLocation 的旧写法
+static void BM_Logger_FilteredCallsite(benchmark::State& state) {
+    logger::LogHandle handle(std::shared_ptr<logger::Sink>{});
+    handle.SetLevel(logger::LogLevel::kError);
+    logger::LogHandle* handle_ptr = &handle;
+    benchmark::DoNotOptimize(handle_ptr);
+    const char* file = __FILE__;
+    benchmark::DoNotOptimize(file);
+
+    for (auto _ : state) {
+        if (state.range(0) == 0) {
+            LOG_LOGGER_INFO(handle_ptr, "filtered");
+        } else {
+            handle_ptr->Log(logger::LogLevel::kInfo, logger::SourceLocation{file, __LINE__, __FUNCTION__}, "filtered");
+        }
+    }
+}
+
 // 注册与运行
 #define BENCH_OPTS RangeMultiplier(4)->Range(64, 4096)->UseRealTime()->Unit(benchmark::kNanosecond)
 
@@ -118,6 +375,41 @@ BENCHMARK(BM_Spdlog_Async)->Threads(4)->BENCH_OPTS;
 BENCHMARK(BM_Effectivelog)->Threads(1)->BENCH_OPTS;
 BENCHMARK(BM_Effectivelog)->Threads(4)->BENCH_OPTS;
 
+// 暂存环模式的线程扩展性 1 -> 16
+BENCHMARK(BM_Effectivelog_Staging)->ThreadRange(1, 16)->BENCH_OPTS;
+
+// 并行压缩 0(串行) / 1 / 2 / 4 / 8 个压缩线程
+BENCHMARK(BM_Effectivelog_CompressWorkers)
+        ->Arg(0)
+        ->Arg(1)
+        ->Arg(2)
+        ->Arg(4)
+        ->Arg(8)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
+// 0: 中间缓冲区路径 (CBC) / 1: 零拷贝路径 (CTR)，消息长度 64 -> 4096
+BENCHMARK(BM_Effectivelog_ZeroCopy)
+        ->ArgsProduct({{0, 1}, {64, 512, 4096}})
+        ->UseRealTime()
+        ->Unit(benchmark::kNanosecond);
+
+BENCHMARK(BM_Effectivelog_PageFaults)->Arg(0)->Arg(1)->Arg(2)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_Effectivelog_FlushThroughput)->Arg(0)->Arg(1)->Arg(2)->UseRealTime()->Unit(benchmark::kMillisecond);
+
+BENCHMARK(BM_Effectivelog_Durability)->DenseRange(0, 3)->UseRealTime()->Unit(benchmark::kNanosecond);
+
+BENCHMARK(BM_Logger_FilteredCallsite)->Arg(0)->Arg(1)->Unit(benchmark::kNanosecond);
+
+BENCHMARK(BM_Effectivelog_StartupRecovery)
+        ->Arg(0)
+        ->Arg(64)
+        ->Arg(256)
+        ->Iterations(10)
+        ->UseRealTime()
+        ->Unit(benchmark::kMillisecond);
+
 int main(int argc, char** argv) {
     // 1. 初始化所有 Logger
     GlobalSetup();
@@ -132,12 +424,29 @@ int main(int argc, char** argv) {
     if (g_spdlog_sync) g_spdlog_sync->flush();
     if (g_spdlog_async) g_spdlog_async->flush();
     if (g_my_sink) g_my_sink->Flush();
+    if (g_my_staging_sink) g_my_staging_sink->Flush();
+    for (int workers : kCompressWorkers) {
+        if (g_compress_sinks[workers]) g_compress_sinks[workers]->Flush();
+    }
+    for (auto& sink : g_copy_sinks) {
+        if (sink) sink->Flush();
+    }
 
     // 4. 销毁资源
     spdlog::drop_all();
     spdlog::shutdown();
     g_my_logger.reset();
     g_my_sink.reset();
+    g_my_staging_logger.reset();
+    g_my_staging_sink.reset();
+    for (int workers : kCompressWorkers) {
+        g_compress_loggers[workers].reset();
+        g_compress_sinks[workers].reset();
+    }
+    for (int zero_copy = 0; zero_copy < 2; ++zero_copy) {
+        g_copy_loggers[zero_copy].reset();
+        g_copy_sinks[zero_copy].reset();
+    }
 
     return 0;
 }
\ No newline at end of file
@@ -1,17 +1,25 @@
+#include <cstring>
 #include <filesystem>
 #include <fstream>
+#include <functional>
 #include <iostream>
 #include <memory>
 #include <streambuf>
 #include <string>
+#include <unordered_map>
 #include <vector>
 
+#include <zdict.h>
+
 #include "decode_formatter.h"
 #include "proto/effective_msg.pb.h"
 #include "compress/zstd_compress.h"
 #include "crypt/crypt.h"
 #include "aes_crypt.h"
+#include "aes_ctr_crypt.h"
+#include "crc32c.h"
 #include "effective_sink.h"
+#include "log_args.h"
 
 using namespace logger;
 using namespace logger::detail;
@@ -36,95 +44,347 @@ void AppendDataToFile(const std::string& file_path, const std::string& data) {
     ofs.write(data.data(), data.size());
 }
 
-std::unique_ptr<logger::compress::ZstdCompress> decompress;
+// 调用点目录 每个chunk独立
+std::unordered_map<uint32_t, EffectiveSite> log_sites;
+
+// 用目录还原调用点的静态信息
+void RestoreSite(EffectiveMsg& msg) {
+    auto iter = log_sites.find(msg.log_id());
+    if (iter == log_sites.end()) {
+        std::cerr << "RestoreSite: unknown log id " << msg.log_id() << std::endl;
+        return;
+    }
+    const EffectiveSite& site = iter->second;
+    msg.set_level(site.level());
+    msg.set_line(site.line());
+    msg.set_file_name(site.file_name());
+    msg.set_func_name(site.func_name());
+    if (msg.log_fmt().empty()) {
+        msg.set_log_fmt(site.log_fmt());
+    }
+}
 
-void DecodeItemData(char* data, size_t size, crypt::Crypt* crypt, std::string& output) {
-    std::string decrypted = crypt->Decrypt(data, size);
-    std::string decompressed = decompress->DeCompress(decrypted.data(), decrypted.size());
+// 返回是否输出了一条日志，目录项不输出
+bool DecodeMsg(const char* data, size_t size, std::string& output) {
     EffectiveMsg msg;
-    msg.ParseFromString(decompressed);
+    msg.ParseFromArray(data, size);
+    if (msg.has_site()) {
+        log_sites[msg.site().log_id()] = msg.site();
+        return false;
+    }
+    if (msg.log_id() != 0) {
+        RestoreSite(msg);
+    }
+    if (!msg.log_args().empty()) {
+        std::string log_info;
+        if (!detail::FormatArgs(msg.log_fmt(), msg.log_args(), &log_info)) {
+            log_info = msg.log_fmt();
+        }
+        msg.set_log_info(log_info);
+    }
     std::string assemble;
     decode_formatter->Format(msg, assemble);
     output.append(assemble);
+    return true;
+}
+
+// 块内的每一条记录 (序列化后的EffectiveMsg) 都交给回调处理
+using RecordHandler = std::function<void(const char* data, size_t size)>;
+
+// 单条item解出一条记录，压缩块解出 [size:4][EffectiveMsg] 序列
+void DecodeItemData(char* data,
+                    size_t size,
+                    uint32_t magic,
+                    crypt::Crypt* crypt,
+                    compress::ZstdCompress* decompress,
+                    const RecordHandler& handler) {
+    // 整chunk加密时item本身是明文，crypt 为空
+    std::string decrypted = crypt ? crypt->Decrypt(data, size) : std::string(data, size);
+    // 压缩块是独立的帧，用单独的上下文解压，同一chunk里穿插的流式item不受影响
+    std::string decompressed = magic == ItemHeader::kBlockMagic
+                                       ? decompress->DeCompressBlock(decrypted.data(), decrypted.size())
+                                       : decompress->DeCompress(decrypted.data(), decrypted.size());
+    if (decompressed.empty()) {
+        throw std::runtime_error("DecodeItemData: decompress failed");
+    }
+    if (magic == ItemHeader::kMagic) {
+        handler(decompressed.data(), decompressed.size());
+        return;
+    }
+
+    size_t offset = 0;
+    while (offset + sizeof(uint32_t) <= decompressed.size()) {
+        uint32_t msg_size = 0;
+        memcpy(&msg_size, decompressed.data() + offset, sizeof(msg_size));
+        offset += sizeof(msg_size);
+        if (offset + msg_size > decompressed.size()) {
+            throw std::runtime_error("DecodeItemData: invalid block record size");
+        }
+        handler(decompressed.data() + offset, msg_size);
+        offset += msg_size;
+    }
+}
+
+// 崩溃记录还原成一条 critical 日志，和普通记录一样交给回调
+void DecodeCrashRecord(const char* data, size_t size, const RecordHandler& handler) {
+    CrashRecord record;
+    if (size < sizeof(record)) {
+        throw std::runtime_error("DecodeCrashRecord: invalid crash record size");
+    }
+    memcpy(&record, data, sizeof(record));
+    EffectiveMsg msg;
+    msg.set_level(static_cast<int32_t>(LogLevel::kCritical));
+    msg.set_timestamp(record.timestamp);
+    msg.set_pid(record.pid);
+    msg.set_tid(record.tid);
+    msg.set_log_info("process crashed by signal " + std::to_string(record.signal));
+    std::string serialized = msg.SerializeAsString();
+    handler(serialized.data(), serialized.size());
+}
+
+// 解压器按字典ID索引，0 表示不使用字典
+std::unordered_map<uint32_t, std::unique_ptr<compress::ZstdCompress>> decompressors;
+
+void LoadDictionary(const std::string& dict_file_path) {
+    auto dict = ReadFile(dict_file_path);
+    auto decompress = std::make_unique<compress::ZstdCompress>();
+    if (!decompress->LoadDictionary(dict.data(), dict.size())) {
+        throw std::runtime_error("LoadDictionary: invalid dictionary " + dict_file_path);
+    }
+    uint32_t dict_id = decompress->DictId();
+    decompressors[dict_id] = std::move(decompress);
+}
+
+compress::ZstdCompress* GetDecompressor(uint32_t dict_id) {
+    auto iter = decompressors.find(dict_id);
+    if (iter == decompressors.end()) {
+        if (dict_id != 0) {
+            throw std::runtime_error("GetDecompressor: missing dictionary " + std::to_string(dict_id));
+        }
+        iter = decompressors.emplace(0, std::make_unique<compress::ZstdCompress>()).first;
+    }
+    return iter->second.get();
 }
 
 void DecodeChunkData(char* data,
                      size_t size,
-                     const std::string& cli_pub_key,
+                     const ChunkHeader& chunk_header,
                      const std::string& svr_pri_key,
-                     std::string& output) {
+                     const RecordHandler& handler) {
     std::cout << "decode chunk " << size << std::endl;
+    std::string cli_pub_key(chunk_header.pub_key, 65);
     std::string svr_pri_key_bin = crypt::HexKeyToBinary(svr_pri_key);
     std::string shared_secret = crypt::ComputeECDHSharedSecret(svr_pri_key_bin, cli_pub_key);
-    std::unique_ptr<crypt::Crypt> crypt = std::make_unique<crypt::AESCrypt>(shared_secret);
+    std::unique_ptr<crypt::Crypt> crypt;
+    if (chunk_header.cipher_mode == static_cast<uint32_t>(crypt::CipherMode::kAesCtr)) {
+        crypt = std::make_unique<crypt::AESCtrCrypt>(shared_secret);
+        crypt->SetNonce(std::string(reinterpret_cast<const char*>(chunk_header.nonce), sizeof(chunk_header.nonce)));
+    } else {
+        crypt = std::make_unique<crypt::AESCrypt>(shared_secret);
+    }
+    compress::ZstdCompress* decompress = GetDecompressor(chunk_header.dict_id);
+    log_sites.clear();
+
+    // 整chunk加密：先把整个chunk作为一段连续密钥流解密，之后item不再单独解密
+    std::string chunk_plain;
+    if (chunk_header.flags & ChunkHeader::kChunkEncrypted) {
+        crypt->Seek(0);
+        chunk_plain = crypt->Decrypt(data, size);
+        data = chunk_plain.data();
+        crypt.reset();
+    }
+    // 写坏的item (崩溃时只写了一半) 跳过并继续，item头本身坏了找不到下一个item的边界，只能放弃这个chunk剩下的部分
+    bool checksum = chunk_header.flags & ChunkHeader::kItemChecksum;
+    size_t header_size = checksum ? sizeof(ItemHeader) : ItemHeader::kSizeV1;
+    bool stream_broken = false;  // 流式压缩的item依赖前面的item，坏了一个之后本chunk后面的流式item都解不出来
     size_t offset = 0;
     size_t count = 0;
+    size_t skipped = 0;
     while (offset < size) {
         ++count;
         if (count % 1000 == 0) {
             std::cout << "decode item " << count << std::endl;
         }
-        ItemHeader* item_header = reinterpret_cast<ItemHeader*>(data + offset);
-        if (item_header->magic != ItemHeader::kMagic) {
-            throw std::runtime_error("DecodeChunkData: invalid item magic");
-            return;
+        ItemHeader item_header;
+        if (size - offset < header_size) {
+            std::cerr << "DecodeChunkData: truncated item header at " << offset << std::endl;
+            ++skipped;
+            break;
+        }
+        memcpy(&item_header, data + offset, header_size);
+        if ((item_header.magic != ItemHeader::kMagic && item_header.magic != ItemHeader::kBlockMagic &&
+             item_header.magic != ItemHeader::kCrashMagic) ||
+            item_header.size > size - offset - header_size) {
+            std::cerr << "DecodeChunkData: invalid item at " << offset << ", skip rest of chunk" << std::endl;
+            ++skipped;
+            break;
+        }
+        offset += header_size;
+        char* payload = data + offset;
+        offset += item_header.size;
+
+        bool stream = item_header.magic == ItemHeader::kMagic;
+        if (checksum && Crc32c(payload, item_header.size) != item_header.crc) {
+            std::cerr << "DecodeChunkData: item checksum mismatch at " << payload - data << std::endl;
+            ++skipped;
+            stream_broken |= stream;
+            continue;
+        }
+        if (stream && stream_broken) {
+            ++skipped;
+            continue;
+        }
+        if (crypt) {
+            crypt->Seek(payload - data);
         }
-        offset += sizeof(ItemHeader);
-        DecodeItemData(data + offset, item_header->size, crypt.get(), output);
-        offset += item_header->size;
-        output.push_back('\n');
+        try {
+            if (item_header.magic == ItemHeader::kCrashMagic) {
+                DecodeCrashRecord(payload, item_header.size, handler);
+                continue;
+            }
+            DecodeItemData(payload, item_header.size, item_header.magic, crypt.get(), decompress, handler);
+        } catch (const std::exception& e) {
+            std::cerr << "DecodeChunkData: skip item at " << payload - data << ": " << e.what() << std::endl;
+            ++skipped;
+            stream_broken |= stream;
+        }
+    }
+    if (skipped > 0) {
+        std::cerr << "DecodeChunkData: skipped " << skipped << " bad items" << std::endl;
     }
 }
 
-void DecodeFile(const std::string& input_file_path, const std::string& pri_key, const std::string& output_file_path) {
-    auto input = ReadFile(input_file_path);
-    if (input.size() < sizeof(ChunkHeader)) {
-        throw std::runtime_error("DecodeFile: input file is too small");
-        return;
+// 解析chunk头，旧格式缺少的字段按0处理 (不使用字典，CBC加密)，返回头部长度，0 表示不是合法的chunk
+size_t ParseChunkHeader(const char* data, size_t size, ChunkHeader* chunk_header) {
+    uint64_t magic = 0;
+    if (size < sizeof(magic)) {
+        return 0;
     }
-    auto chunk_header = reinterpret_cast<ChunkHeader*>(input.data());
-    if (chunk_header->magic != ChunkHeader::kMagic) {
-        throw std::runtime_error("DecodeFile: invalid file magic");
-        return;
+    memcpy(&magic, data, sizeof(magic));
+
+    size_t header_size = 0;
+    if (magic == ChunkHeader::kMagic) {
+        header_size = sizeof(ChunkHeader);
+    } else if (magic == ChunkHeader::kMagicV3) {
+        header_size = ChunkHeader::kSizeV3;
+    } else if (magic == ChunkHeader::kMagicV2) {
+        header_size = ChunkHeader::kSizeV2;
+    } else if (magic == ChunkHeader::kMagicV1) {
+        header_size = ChunkHeader::kSizeV1;
+    } else {
+        return 0;
     }
+    if (size < header_size) {
+        return 0;
+    }
+    memcpy(chunk_header, data, header_size);
+    return header_size;
+}
+
+// 逐个chunk解出文件里的所有记录，on_chunk_end 在每个chunk处理完后调用
+void ForEachRecord(const std::string& input_file_path,
+                   const std::string& pri_key,
+                   const RecordHandler& handler,
+                   const std::function<void()>& on_chunk_end) {
+    auto input = ReadFile(input_file_path);
     size_t offset = 0;
     size_t file_size = input.size();
-    std::string output;
-    output.reserve(1024 * 1024);
     while (offset < file_size) {
-        ChunkHeader* chunk_header = reinterpret_cast<ChunkHeader*>(input.data() + offset);
-        if (chunk_header->magic != ChunkHeader::kMagic) {
-            throw std::runtime_error("DecodeFile: invalid chunk magic");
-            return;
+        ChunkHeader chunk_header;
+        size_t header_size = ParseChunkHeader(input.data() + offset, file_size - offset, &chunk_header);
+        if (header_size == 0) {
+            throw std::runtime_error("ForEachRecord: invalid chunk magic");
+        }
+        offset += header_size;
+        if (offset + chunk_header.size > file_size) {
+            throw std::runtime_error("ForEachRecord: truncated chunk");
         }
-        output.clear();
-        offset += sizeof(ChunkHeader);
-        DecodeChunkData(
-                input.data() + offset, chunk_header->size, std::string(chunk_header->pub_key, 65), pri_key, output);
-        offset += chunk_header->size;
-        AppendDataToFile(output_file_path, output);
+        DecodeChunkData(input.data() + offset, chunk_header.size, chunk_header, pri_key, handler);
+        offset += chunk_header.size;
+        on_chunk_end();
     }
 }
 
-int main(int argc, char* argv[]) {
-    // ./decode <file_path> <pri_key> <output_file>
-#if 0
-    if (argc != 4) {
-        std::cerr << "Usage: ./decode <file_path> <pri_key> <output_file>" << std::endl;
-        return 1;
+void DecodeFile(const std::string& input_file_path, const std::string& pri_key, const std::string& output_file_path) {
+    std::string output;
+    output.reserve(1024 * 1024);
+    ForEachRecord(
+            input_file_path,
+            pri_key,
+            [&output](const char* data, size_t size) {
+                if (DecodeMsg(data, size, output)) {
+                    output.push_back('\n');
+                }
+            },
+            [&output, &output_file_path]() {
+                AppendDataToFile(output_file_path, output);
+                output.clear();
+            });
+}
+
+// 用已有日志里的记录训练字典，样本是压缩前的EffectiveMsg，与写入端压缩的数据一致
+void TrainDictionary(const std::vector<std::string>& input_file_paths,
+                     const std::string& pri_key,
+                     size_t dict_capacity,
+                     const std::string& dict_file_path) {
+    std::string samples;
+    std::vector<size_t> sample_sizes;
+    for (const auto& input_file_path : input_file_paths) {
+        ForEachRecord(
+                input_file_path,
+                pri_key,
+                [&samples, &sample_sizes](const char* data, size_t size) {
+                    samples.append(data, size);
+                    sample_sizes.push_back(size);
+                },
+                []() {});
     }
-    std::string input_file_path = argv[1];
-    std::string pri_key = argv[2];
-    std::string output_file_path = argv[3];
-#else
-    std::string input_file_path = "/home/kang/logger/build/examples/logs/loggerdemo_2025-12-18 17:14:53.log";
-    std::string pri_key = "FAA5BBE9017C96BF641D19D0144661885E831B5DDF52539EF1AB4790C05E665E";
-    std::string output_file_path = "d.txt";
-#endif
+    std::cout << "train samples " << sample_sizes.size() << ", bytes " << samples.size() << std::endl;
+
+    std::string dict(dict_capacity, '\0');
+    size_t dict_size = ZDICT_trainFromBuffer(
+            dict.data(), dict.size(), samples.data(), sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()));
+    if (ZDICT_isError(dict_size)) {
+        throw std::runtime_error(std::string("TrainDictionary: ") + ZDICT_getErrorName(dict_size));
+    }
+    dict.resize(dict_size);
+
+    std::ofstream ofs(dict_file_path, std::ios::binary | std::ios::trunc);
+    ofs.write(dict.data(), dict.size());
+    std::cout << "dictionary " << dict_file_path << ", id " << ZSTD_getDictID_fromDict(dict.data(), dict.size())
+              << ", bytes " << dict.size() << std::endl;
+}
+
+static void PrintUsage() {
+    std::cerr << "Usage:" << std::endl;
+    std::cerr << "  ./logger-decode <file_path> <pri_key> <output_file> [dict_file...]" << std::endl;
+    std::cerr << "  ./logger-decode train <pri_key> <dict_file> <dict_kb> <file_path...>" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
     try {
+        if (argc >= 6 && std::string(argv[1]) == "train") {
+            std::string pri_key = argv[2];
+            std::string dict_file_path = argv[3];
+            size_t dict_capacity = std::stoul(argv[4]) * 1024;
+            std::vector<std::string> input_file_paths(argv + 5, argv + argc);
+            TrainDictionary(input_file_paths, pri_key, dict_capacity, dict_file_path);
+            return 0;
+        }
+
+        if (argc < 4) {
+            PrintUsage();
+            return 1;
+        }
+        std::string input_file_path = argv[1];
+        std::string pri_key = argv[2];
+        std::string output_file_path = argv[3];
+        for (int i = 4; i < argc; ++i) {
+            LoadDictionary(argv[i]);
+        }
+
         decode_formatter = std::make_unique<DecodeFormatter>();
         decode_formatter->SetPattern("[%l][%D:%S][%p:%t][%F:%f:%#]%v");
-        decompress = std::make_unique<logger::compress::ZstdCompress>();
         DecodeFile(input_file_path, pri_key, output_file_path);
     } catch (const std::exception& e) {
         std::cerr << "Decode failed: " << e.what() << std::endl;
@@ -12,10 +12,16 @@ public:
 
     virtual size_t Compress(const void* input_data, size_t input_size, void* output_data, size_t output_size) = 0;
 
+    // 把一整块数据压缩成独立的帧，不依赖也不影响流式压缩的状态
+    virtual size_t CompressBlock(const void* input_data, size_t input_size, void* output_data, size_t output_size) = 0;
+
     virtual size_t CompressBound(size_t input_size) = 0;  // 计算压缩后的大小
 
     virtual std::string DeCompress(const void* input, size_t input_size) = 0;  // 解压缩
 
+    // 解压 CompressBlock 生成的独立帧，使用单独的上下文，不影响 DeCompress 的流式状态
+    virtual std::string DeCompressBlock(const void* input, size_t input_size) = 0;
+
     virtual void ResetStream() = 0;  // 重置状态
 };
 }  // namespace compress
@@ -71,8 +71,27 @@ size_t ZlibCompress::Compress(const void* input_data, size_t input_size, void* o
     return out_len;
 }
 
+size_t ZlibCompress::CompressBlock(const void* input_data, size_t input_size, void* output_data, size_t output_size) {
+    if (!input_data || input_size == 0 || !output_data) {
+        return 0;
+    }
+
+    // 独立的zlib流，自带zlib头，解压时据此重置上下文
+    uLongf out_len = output_size;
+    int ret = compress2(static_cast<Bytef*>(output_data),
+                        &out_len,
+                        static_cast<const Bytef*>(input_data),
+                        input_size,
+                        Z_BEST_COMPRESSION);
+    if (ret != Z_OK) {
+        return 0;
+    }
+    return out_len;
+}
+
 size_t ZlibCompress::CompressBound(size_t input_size) {
-    return input_size + 10;
+    // 块压缩输出的是完整的zlib流，按zlib给出的最坏情况估算
+    return compressBound(input_size) + 10;
 }
 
 std::string ZlibCompress::DeCompress(const void* input_data, size_t input_size) {
@@ -103,6 +122,34 @@ std::string ZlibCompress::DeCompress(const void* input_data, size_t input_size)
     return output;
 }
 
+std::string ZlibCompress::DeCompressBlock(const void* input_data, size_t input_size) {
+    if (!input_data || input_size == 0) {
+        return "";
+    }
+
+    // 每块是完整的zlib流，用临时的解压流，不影响流式解压的状态
+    std::unique_ptr<z_stream, ZStreamInflateDeleter> stream(new z_stream());
+    if (inflateInit2(stream.get(), MAX_WBITS) != Z_OK) {
+        return "";
+    }
+    stream->next_in = (Bytef*) input_data;
+    stream->avail_in = input_size;
+
+    std::string output;
+    int ret = Z_OK;
+    while (ret != Z_STREAM_END) {
+        char buffer[4096];
+        stream->next_out = (Bytef*) buffer;
+        stream->avail_out = sizeof(buffer);
+        ret = inflate(stream.get(), Z_NO_FLUSH);
+        if (ret != Z_OK && ret != Z_STREAM_END) {
+            return "";
+        }
+        output.append(buffer, sizeof(buffer) - stream->avail_out);
+    }
+    return output;
+}
+
 void ZlibCompress::ResetStream() {
     compress_stream_ = std::unique_ptr<z_stream, ZStreamDeflateDeleter>(new z_stream());
     compress_stream_->zalloc = Z_NULL;
@@ -36,10 +36,14 @@ public:
 
     size_t Compress(const void* input_data, size_t input_size, void* output_data, size_t output_size) override;
 
+    size_t CompressBlock(const void* input_data, size_t input_size, void* output_data, size_t output_size) override;
+
     size_t CompressBound(size_t input_size) override;  // 计算压缩后的大小
 
     std::string DeCompress(const void* input_data, size_t input_size) override;  // 解压缩
 
+    std::string DeCompressBlock(const void* input_data, size_t input_size) override;
+
     void ResetStream() override;  // 重置压缩缓存区
 private:
     void ResetDecompressStream();
@@ -29,7 +29,13 @@ ZstdCompress::ZstdCompress() {
 
     ZSTD_CCtx_setParameter(cctx_, ZSTD_c_compressionLevel, 5);
 
+    block_cctx_ = ZSTD_createCCtx();
+
+    ZSTD_CCtx_setParameter(block_cctx_, ZSTD_c_compressionLevel, 5);
+
     dctx_ = ZSTD_createDCtx();
+
+    block_dctx_ = ZSTD_createDCtx();
 }
 
 ZstdCompress::~ZstdCompress() {
@@ -37,9 +43,45 @@ ZstdCompress::~ZstdCompress() {
         ZSTD_freeCCtx(cctx_);
     }
 
+    if (block_cctx_) {
+        ZSTD_freeCCtx(block_cctx_);
+    }
+
     if (dctx_) {
         ZSTD_freeDCtx(dctx_);
     }
+
+    if (block_dctx_) {
+        ZSTD_freeDCtx(block_dctx_);
+    }
+
+    if (cdict_) {
+        ZSTD_freeCDict(cdict_);
+    }
+
+    if (ddict_) {
+        ZSTD_freeDDict(ddict_);
+    }
+}
+
+bool ZstdCompress::LoadDictionary(const void* dict_data, size_t dict_size) {
+    if (!dict_data || dict_size == 0 || cdict_ || ddict_) {
+        return false;
+    }
+
+    cdict_ = ZSTD_createCDict(dict_data, dict_size, 5);
+    ddict_ = ZSTD_createDDict(dict_data, dict_size);
+    if (!cdict_ || !ddict_) {
+        return false;
+    }
+
+    // 只重置会话时引用的字典保持不变
+    if (ZSTD_isError(ZSTD_CCtx_refCDict(cctx_, cdict_)) || ZSTD_isError(ZSTD_CCtx_refCDict(block_cctx_, cdict_)) ||
+        ZSTD_isError(ZSTD_DCtx_refDDict(dctx_, ddict_)) || ZSTD_isError(ZSTD_DCtx_refDDict(block_dctx_, ddict_))) {
+        return false;
+    }
+    dict_id_ = ZSTD_getDictID_fromDict(dict_data, dict_size);
+    return true;
 }
 
 size_t ZstdCompress::Compress(const void* input_data, size_t input_size, void* output_data, size_t output_size) {
@@ -62,6 +104,24 @@ size_t ZstdCompress::Compress(const void* input_data, size_t input_size, void* o
     return output_buffer.pos;
 }
 
+size_t ZstdCompress::CompressBlock(const void* input_data, size_t input_size, void* output_data, size_t output_size) {
+    if (!input_data || input_size == 0 || !output_data) {
+        return 0;
+    }
+
+    if (!block_cctx_) {
+        return 0;
+    }
+
+    // 每块是一个完整的zstd帧，帧头带魔数，解压时据此重置上下文
+    size_t ret = ZSTD_compress2(block_cctx_, output_data, output_size, input_data, input_size);
+
+    if (ZSTD_isError(ret) != 0) {
+        return 0u;
+    }
+    return ret;
+}
+
 size_t ZstdCompress::CompressBound(size_t input_size) {
     return ZSTD_compressBound(input_size);
 }
@@ -73,16 +133,34 @@ std::string ZstdCompress::DeCompress(const void* input_data, size_t input_size)
     if (IsZstdCompressed(input_data, input_size)) {
         ResetDecompressStream();
     }
-    std::string output;
-    output.reserve(10 * 1024);
-    ZSTD_inBuffer input = {input_data, input_size, 0};
-    ZSTD_outBuffer output_buffer = {
-            const_cast<void*>(reinterpret_cast<const void*>(output.data())), output.capacity(), 0};
-    size_t ret = ZSTD_decompressStream(dctx_, &output_buffer, &input);
-    if (ZSTD_isError(ret) != 0) {
+    return DeCompressWith(dctx_, input_data, input_size);
+}
+
+std::string ZstdCompress::DeCompressBlock(const void* input_data, size_t input_size) {
+    if (!input_data || input_size == 0 || !block_dctx_) {
         return "";
     }
-    output = std::string(reinterpret_cast<char*>(output_buffer.dst), output_buffer.pos);
+    ZSTD_DCtx_reset(block_dctx_, ZSTD_reset_session_only);
+    return DeCompressWith(block_dctx_, input_data, input_size);
+}
+
+std::string ZstdCompress::DeCompressWith(ZSTD_DCtx* dctx, const void* input_data, size_t input_size) {
+    // 一次解压的输出可能超过缓冲区，循环直到输入全部消费且没有待输出的数据
+    std::string output;
+    char buffer[16 * 1024];
+    ZSTD_inBuffer input = {input_data, input_size, 0};
+    size_t ret = 0;
+    do {
+        ZSTD_outBuffer output_buffer = {buffer, sizeof(buffer), 0};
+        ret = ZSTD_decompressStream(dctx, &output_buffer, &input);
+        if (ZSTD_isError(ret) != 0) {
+            return "";
+        }
+        output.append(buffer, output_buffer.pos);
+        if (output_buffer.pos < output_buffer.size && input.pos == input.size) {
+            break;
+        }
+    } while (input.pos < input.size || ret != 0);
     return output;
 }
 
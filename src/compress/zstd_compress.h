@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <memory>
 #include <zstd.h>
 
@@ -15,18 +16,38 @@ public:
 
     size_t Compress(const void* input_data, size_t input_size, void* output_data, size_t output_size) override;
 
+    size_t CompressBlock(const void* input_data, size_t input_size, void* output_data, size_t output_size) override;
+
     size_t CompressBound(size_t input_size) override;  // 计算压缩后的大小
 
     std::string DeCompress(const void* input_data, size_t input_size) override;  // 解压缩
 
+    std::string DeCompressBlock(const void* input_data, size_t input_size) override;
+
     void ResetStream() override;  // 重置压缩缓存区
 
+    // 加载训练好的字典，之后的压缩和解压都基于该字典，压缩端和解压端必须使用同一份字典
+    bool LoadDictionary(const void* dict_data, size_t dict_size);
+
+    uint32_t DictId() const {
+        return dict_id_;
+    }
+
 private:
     void ResetDecompressStream();
 
+    static std::string DeCompressWith(ZSTD_DCtx* dctx, const void* input_data, size_t input_size);
+
 private:
     ZSTD_CCtx* cctx_;
+    ZSTD_CCtx* block_cctx_;  // 块压缩单独使用，避免打断流式压缩的上下文
     ZSTD_DCtx* dctx_;
+    ZSTD_DCtx* block_dctx_;  // 独立块单独解压，块帧不会重置流式解压的上下文
+
+    // 预处理过的字典，避免每帧重新加载
+    ZSTD_CDict* cdict_{nullptr};
+    ZSTD_DDict* ddict_{nullptr};
+    uint32_t dict_id_{0};
 };
 }  // namespace compress
 }  // namespace logger
\ No newline at end of file
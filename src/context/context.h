@@ -45,3 +45,5 @@ private:
 
 #define POST_REPEATED_TASK(runner_tag, task, interval__time, repeat_num) \
     EXECUTOR->PostRepeatedTask(runner_tag, task, interval__time, repeat_num)
+
+#define CANCEL_REPEATED_TASK(task_id) EXECUTOR->CancelRepeatedTask(task_id)
@@ -99,13 +99,14 @@ void Executor::ExecutorTimer::PostRepeatedTask(Task task,
                                                RepeatedTaskID repeated_task_id,
                                                uint64_t repeat_num) {
     {
+        // 在锁内提交，CancelRepeatedTask 返回之后不会再提交这个任务
         std::lock_guard<std::mutex> lock(repeated_task_id_set_mutex_);
         if (!repeated_task_id_set_.count(repeated_task_id) || repeat_num == 0) {
             return;
         }
-    }
 
-    task();  // 这个如果是个耗时操作, 可以放在其他工作类型调度器，定时器调度器来调度这个工作调度器件
+        task();  // 这个如果是个耗时操作, 可以放在其他工作类型调度器，定时器调度器来调度这个工作调度器件
+    }
 
     Task next_repeated = [this, task, interval__time, repeated_task_id, repeat_num]() {
         this->PostRepeatedTask(std::move(task), interval__time, repeated_task_id, repeat_num - 1);
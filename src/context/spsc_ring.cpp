@@ -0,0 +1,64 @@
+#include "spsc_ring.h"
+
+#include <cstring>
+
+namespace logger {
+
+static size_t RoundUpPowerOfTwo(size_t size) {
+    size_t capacity = 64;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+    return capacity;
+}
+
+SpscRing::SpscRing(size_t capacity)
+        : capacity_(RoundUpPowerOfTwo(capacity)), mask_(capacity_ - 1), buf_(new uint8_t[capacity_]) {}
+
+void* SpscRing::Reserve(uint32_t size) {
+    size_t need = RecordSize(size);
+    uint64_t pos = head_.load(std::memory_order_relaxed);
+    size_t index = pos & mask_;
+    size_t contiguous = capacity_ - index;
+    // 尾部连续空间不够时，剩余部分作废，记录从环首开始
+    size_t total = need > contiguous ? contiguous + need : need;
+    if (total > capacity_) {
+        return nullptr;
+    }
+
+    if (pos + total - cached_tail_ > capacity_) {
+        cached_tail_ = tail_.load(std::memory_order_acquire);
+        if (pos + total - cached_tail_ > capacity_) {
+            return nullptr;
+        }
+    }
+
+    if (need > contiguous) {
+        uint32_t wrap = kWrapMark;
+        memcpy(buf_.get() + index, &wrap, sizeof(wrap));
+        pos += contiguous;
+        index = 0;
+    }
+
+    memcpy(buf_.get() + index, &size, sizeof(size));
+    pending_head_ = pos + need;
+    return buf_.get() + index + kHeaderSize;
+}
+
+bool SpscRing::Commit() {
+    head_.store(pending_head_, std::memory_order_release);
+    if (pending_head_ < wake_check_) {
+        return false;
+    }
+
+    size_t high_water = capacity_ / 2;
+    cached_tail_ = tail_.load(std::memory_order_acquire);
+    if (pending_head_ - cached_tail_ >= high_water) {
+        wake_check_ = pending_head_ + capacity_ / 8;
+        return true;
+    }
+    wake_check_ = cached_tail_ + high_water;
+    return false;
+}
+
+}  // namespace logger
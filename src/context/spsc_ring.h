@@ -0,0 +1,85 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+namespace logger {
+
+// 单生产者单消费者的无锁字节环，存放变长记录
+// 生产者只写 head_，消费者只写 tail_，两者位于不同的缓存行，
+// 生产者只有在本地缓存的 tail 显示空间不足时才会去读消费者的缓存行
+class SpscRing {
+public:
+    explicit SpscRing(size_t capacity);  // 容量向上取2的幂
+    ~SpscRing() = default;
+
+    SpscRing(const SpscRing& other) = delete;
+    SpscRing& operator=(const SpscRing& other) = delete;
+
+    // 生产者：预留一段连续空间，写完后调用 Commit 发布；空间不足返回 nullptr
+    void* Reserve(uint32_t size);
+
+    // 返回 true 表示已用空间越过高水位 (容量的一半)，需要唤醒消费者；消费者没跟上时每再写入 1/8 容量提醒一次
+    // 只在写到检查点时读一次消费者的位置，其余时候不碰消费者的缓存行
+    bool Commit();
+
+    // 记录是否可能放入环中，超过容量一半的记录需要走其他路径
+    bool Fits(uint32_t size) const {
+        return RecordSize(size) <= capacity_ / 2;
+    }
+
+    // 消费者：按写入顺序回调所有已发布的记录 f(const uint8_t* data, uint32_t size)，返回记录数
+    template <typename F>
+    size_t Consume(F&& f) {
+        uint64_t head = head_.load(std::memory_order_acquire);
+        uint64_t pos = tail_.load(std::memory_order_relaxed);
+        size_t count = 0;
+        while (pos < head) {
+            size_t index = pos & mask_;
+            uint32_t size = *reinterpret_cast<const uint32_t*>(buf_.get() + index);
+            if (size == kWrapMark) {  // 尾部放不下，记录从环首开始
+                pos += capacity_ - index;
+                continue;
+            }
+            f(buf_.get() + index + kHeaderSize, size);
+            pos += RecordSize(size);
+            ++count;
+        }
+        tail_.store(pos, std::memory_order_release);
+        return count;
+    }
+
+    bool Empty() const {
+        return head_.load(std::memory_order_acquire) == tail_.load(std::memory_order_acquire);
+    }
+
+    size_t Capacity() const {
+        return capacity_;
+    }
+
+private:
+    static constexpr uint32_t kWrapMark = 0xffffffff;
+    static constexpr size_t kHeaderSize = 8;  // [size:4][padding:4] 保证记录8字节对齐
+
+    static size_t RecordSize(uint32_t size) {
+        return (kHeaderSize + size + 7) & ~static_cast<size_t>(7);
+    }
+
+private:
+    size_t capacity_;
+    size_t mask_;
+    std::unique_ptr<uint8_t[]> buf_;
+
+    // 生产者独占
+    alignas(64) std::atomic<uint64_t> head_{0};
+    uint64_t cached_tail_{0};
+    uint64_t pending_head_{0};
+    uint64_t wake_check_{0};  // 写到这个位置时检查一次高水位
+
+    // 消费者独占
+    alignas(64) std::atomic<uint64_t> tail_{0};
+};
+
+}  // namespace logger
@@ -1,5 +1,7 @@
 #include "thread_pool.h"
 
+#include "internal_log.h"
+
 namespace logger {
 
 ThreadPool::ThreadPool(size_t pool_size) : pool_size_(pool_size) {
@@ -11,6 +13,10 @@ bool ThreadPool::Start() {
     if (is_running_.load()) {
         return false;
     }
+    {
+        std::lock_guard<std::mutex> lock(mutex_task_que_);
+        accepting_tasks_ = true;
+    }
     is_running_.store(true);
     CreatePoolWorkers();
     return true;
@@ -20,9 +26,26 @@ void ThreadPool::Stop() {
     if (!is_running_.load()) {
         return;
     }
-    is_running_.store(false);
+    {
+        std::lock_guard<std::mutex> lock(mutex_task_que_);
+        stop_deadline_ = std::chrono::steady_clock::now() + kStopDrainTimeout;
+        is_running_.store(false);
+    }
     cv_.notify_all();
     DeletePoolWorkers();
+
+    // 工作线程都已退出，剩下的是超时后没来得及执行的任务，析构时 future 收到 broken_promise
+    std::queue<std::function<void(void)>> dropped;
+    {
+        std::lock_guard<std::mutex> lock(mutex_task_que_);
+        accepting_tasks_ = false;
+        dropped.swap(task_que_);
+    }
+    if (!dropped.empty()) {
+        LOG_ERROR("ThreadPool: stop timed out after {}s, dropped {} queued tasks",
+                  kStopDrainTimeout.count(),
+                  dropped.size());
+    }
 }
 
 void ThreadPool::CreatePoolWorkers() {
@@ -35,7 +58,9 @@ void ThreadPool::CreatePoolWorkers() {
 
                     cv_.wait(lock, [this]() { return !is_running_.load() || !task_que_.empty(); });
 
-                    if (!is_running_.load()) {
+                    // 停止后继续执行排队的任务，队列空了或者超过期限才退出
+                    if (!is_running_.load() &&
+                        (task_que_.empty() || std::chrono::steady_clock::now() >= stop_deadline_)) {
                         break;
                     }
 
@@ -44,13 +69,24 @@ void ThreadPool::CreatePoolWorkers() {
                 }
 
                 if (now_task) {
-                    now_task();
+                    RunTask(now_task);
                 }
             }
         })));
     }
 }
 
+// 异常不能离开工作线程，否则进程直接终止；停止期间提交到其他已停止线程池的后续任务就会在这里失败
+void ThreadPool::RunTask(const std::function<void()>& task) {
+    try {
+        task();
+    } catch (const std::exception& e) {
+        LOG_ERROR("ThreadPool: task failed: {}", e.what());
+    } catch (...) {
+        LOG_ERROR("ThreadPool: task failed with unknown exception");
+    }
+}
+
 void ThreadPool::DeletePoolWorkers() {
     if (is_running_.load()) {
         return;
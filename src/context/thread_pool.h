@@ -2,6 +2,7 @@
 
 #include <thread>
 #include <atomic>
+#include <chrono>
 #include <mutex>
 #include <condition_variable>
 #include <vector>
@@ -25,6 +26,8 @@ public:
 
     bool Start();
 
+    // 已经排队的任务全部执行完后工作线程再退出；排队的任务执行时还可以提交后续任务，工作线程退出后才拒绝提交
+    // 最多执行 kStopDrainTimeout，不停提交后续任务也不会卡住析构，超时后还没开始的任务被丢弃
     void Stop();
 
     size_t Size() const {
@@ -34,15 +37,14 @@ public:
     // 提交任务,获取返回值
     template <typename F, typename... Args>
     void Submit(F&& f, Args&&... argc) {
-        if (!is_running_) {
-            throw std::runtime_error("submit on stopped ThreadPool");
-        }
-
         // 绑定可调用对象
         auto bound_task = std::bind(std::forward<F>(f), std::forward<Args>(argc)...);
 
         {
             std::unique_lock<std::mutex> lock(mutex_task_que_);
+            if (!accepting_tasks_) {
+                throw std::runtime_error("submit on stopped ThreadPool");
+            }
             task_que_.emplace(std::move(bound_task));
         }
 
@@ -52,10 +54,6 @@ public:
     // 提交任务,获取返回值
     template <typename F, typename... Args>
     auto SubmitWithFuture(F&& f, Args&&... argc) -> std::future<std::invoke_result_t<F, Args...>> {
-        if (!is_running_) {
-            throw std::runtime_error("submit on stopped ThreadPool");
-        }
-
         using return_type = std::invoke_result_t<F, Args...>;
 
         // 绑定可调用对象
@@ -69,6 +67,9 @@ public:
 
         {
             std::unique_lock<std::mutex> lock(mutex_task_que_);
+            if (!accepting_tasks_) {
+                throw std::runtime_error("submit on stopped ThreadPool");
+            }
             // function 接受的对象需要可拷贝可移动， packaged_task 不支持拷贝，故使用lambda表达式 内部调用
             // shared_ptr进行封装
             task_que_.emplace([share_ptr_task]() { (*share_ptr_task)(); });
@@ -88,13 +89,19 @@ private:
     std::atomic<bool> is_running_;
     std::mutex mutex_task_que_;
     std::condition_variable cv_;
+    std::chrono::steady_clock::time_point stop_deadline_;  // 停止后排队的任务在这之前执行完，由 mutex_task_que_ 保护
+    bool accepting_tasks_{false};  // 从 Start 到工作线程全部退出之间接收任务，由 mutex_task_que_ 保护
 
     size_t pool_size_;
 
 private:
+    static constexpr std::chrono::seconds kStopDrainTimeout{5};
+
     void CreatePoolWorkers();
 
     void DeletePoolWorkers();
+
+    void RunTask(const std::function<void()>& task);
 };
 
 }  // namespace logger
\ No newline at end of file
@@ -0,0 +1,65 @@
+#include "aes_ctr_crypt.h"
+
+#include <cryptopp/aes.h>
+#include <cryptopp/cryptlib.h>
+#include <cryptopp/modes.h>
+#include <cryptopp/osrng.h>
+
+namespace logger {
+namespace crypt {
+
+struct AESCtrCrypt::Impl {
+    // CTR模式加解密是同一个运算，一个对象即可
+    CryptoPP::CTR_Mode<CryptoPP::AES>::Encryption cipher;
+};
+
+AESCtrCrypt::AESCtrCrypt(const std::string& key) : impl_(std::make_unique<Impl>()) {
+    // 密钥扩展只在这里做一次，之后每个chunk只重置计数器
+    CryptoPP::byte iv[CryptoPP::AES::BLOCKSIZE] = {0};
+    impl_->cipher.SetKeyWithIV(reinterpret_cast<const CryptoPP::byte*>(key.data()), key.size(), iv, sizeof(iv));
+}
+
+AESCtrCrypt::~AESCtrCrypt() = default;
+
+std::string AESCtrCrypt::GenerateNonce() {
+    CryptoPP::AutoSeededRandomPool rnd;
+
+    std::string nonce(kNonceSize, '\0');
+
+    rnd.GenerateBlock(reinterpret_cast<CryptoPP::byte*>(nonce.data()), nonce.size());
+
+    return nonce;
+}
+
+void AESCtrCrypt::Encrypt(const void* input_data, size_t input_size, std::string& output_data) {
+    size_t origin_size = output_data.size();
+    output_data.resize(origin_size + input_size);
+    impl_->cipher.ProcessData(reinterpret_cast<CryptoPP::byte*>(output_data.data() + origin_size),
+                              static_cast<const CryptoPP::byte*>(input_data),
+                              input_size);
+}
+
+bool AESCtrCrypt::EncryptInPlace(void* data, size_t size) {
+    auto* bytes = static_cast<CryptoPP::byte*>(data);
+    impl_->cipher.ProcessData(bytes, bytes, size);
+    return true;
+}
+
+std::string AESCtrCrypt::Decrypt(const void* input_data, size_t input_size) {
+    std::string output;
+    Encrypt(input_data, input_size, output);
+    return output;
+}
+
+void AESCtrCrypt::SetNonce(const std::string& nonce) {
+    // 只重置计数器，不重新扩展密钥
+    impl_->cipher.Resynchronize(reinterpret_cast<const CryptoPP::byte*>(nonce.data()), static_cast<int>(nonce.size()));
+}
+
+void AESCtrCrypt::Seek(uint64_t offset) {
+    // 计数器 = nonce + offset / 16，并跳过块内的 offset % 16 字节
+    impl_->cipher.Seek(offset);
+}
+
+}  // namespace crypt
+}  // namespace logger
@@ -0,0 +1,35 @@
+#pragma once
+
+#include "crypt.h"
+
+#include <memory>
+#include <string>
+
+namespace logger {
+namespace crypt {
+// AES-CTR 流加密：密钥只扩展一次，加解密直接异或密钥流，不需要填充
+// 同一个chunk内按字节偏移定位密钥流，只要偏移不重复，密钥流就不会重复使用
+class AESCtrCrypt final : public Crypt {
+public:
+    static constexpr size_t kNonceSize = 16;
+
+    explicit AESCtrCrypt(const std::string& key);
+    ~AESCtrCrypt() override;
+
+    static std::string GenerateNonce();
+
+    void Encrypt(const void* input_data, size_t input_size, std::string& output_data) override;
+    std::string Decrypt(const void* input_data, size_t input_size) override;
+
+    bool EncryptInPlace(void* data, size_t size) override;
+
+    void SetNonce(const std::string& nonce) override;
+
+    void Seek(uint64_t offset) override;
+
+private:
+    struct Impl;  // 隐藏cryptopp的类型
+    std::unique_ptr<Impl> impl_;
+};
+}  // namespace crypt
+}  // namespace logger
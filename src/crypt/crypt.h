@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <tuple>
 
@@ -16,6 +17,12 @@ std::string BinaryKeyToHex(const std::string& binary_key);
 
 std::string HexKeyToBinary(const std::string& hex_key);
 
+// 加密模式，数值会写入文件头，不能修改已有的值
+enum class CipherMode : uint32_t {
+    kAesCbc = 0,  // 每条item独立CBC加密，固定iv，需要填充到16字节
+    kAesCtr = 1,  // CTR流加密，每个chunk一个随机nonce，无填充
+};
+
 class Crypt {
 public:
     Crypt() = default;
@@ -23,6 +30,17 @@ public:
 
     virtual void Encrypt(const void* input_data, size_t input_size, std::string& output_data) = 0;
     virtual std::string Decrypt(const void* input_data, size_t input_size) = 0;
+
+    // 原地加密，密文与明文等长的流加密才支持，不支持返回 false
+    virtual bool EncryptInPlace(void* data, size_t size) {
+        return false;
+    }
+
+    // 流加密按数据在chunk内的位置取密钥流：nonce 每个chunk一个，offset 为数据在chunk内的字节偏移
+    // 块加密模式不需要，默认忽略
+    virtual void SetNonce(const std::string& nonce) {}
+
+    virtual void Seek(uint64_t offset) {}
 };
 
 }  // namespace crypt
@@ -3,6 +3,7 @@
 #include <cstring>
 
 #include "sys_util.h"
+#include "log_args.h"
 
 namespace logger {
 
@@ -16,17 +17,17 @@ void DefaultFormatter::Format(const LogMsg& msg, MemoryBuffer* dest) {
     dest->append("[", 1);
     dest->append(time_buf, std::strlen(time_buf));
     dest->append("] [", 3);
-    dest->append(1, kLogLevelStr[static_cast<int>(msg.level)]);
+    dest->append(1, kLogLevelStr[static_cast<int>(msg.Level())]);
     dest->append("] [", 3);
-    dest->append(msg.location.file_name.data(), msg.location.file_name.size());
+    dest->append(msg.Location().file_name.data(), msg.Location().file_name.size());
     dest->append(":", 1);
-    dest->append(std::to_string(msg.location.line));
+    dest->append(std::to_string(msg.Location().line));
     dest->append("] [", 3);
     dest->append(std::to_string(GetProcessId()));
     dest->append(":", 1);
     dest->append(std::to_string(GetThreadId()));
     dest->append("] ", 2);
-    dest->append(msg.message.data(), msg.message.size());
+    detail::FormatLogMessage(msg, dest);
 }
 
 }  // namespace logger
\ No newline at end of file
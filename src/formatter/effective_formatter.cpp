@@ -9,20 +9,53 @@ namespace logger {
 
 void EffectiveFormatter::Format(const LogMsg& msg, MemoryBuffer* dest) {
     EffectiveMsg effective_msg;
-    effective_msg.set_level(static_cast<int>(msg.level));
     // 纪元时间 跨平台 milliseconds
     effective_msg.set_timestamp(
             std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
                     .count());
     effective_msg.set_pid(GetProcessId());
     effective_msg.set_tid(GetThreadId());
-    effective_msg.set_line(msg.location.line);
-    effective_msg.set_file_name(msg.location.file_name.data(), msg.location.file_name.size());
-    effective_msg.set_func_name(msg.location.fun_name.data(), msg.location.fun_name.size());
-    effective_msg.set_log_info(msg.message.data(), msg.message.size());
+
+    bool has_site = msg.site->Id() != 0;
+    if (has_site) {
+        // 调用点的静态信息已写入目录，日志只携带ID
+        effective_msg.set_log_id(msg.site->Id());
+    } else {
+        effective_msg.set_level(static_cast<int>(msg.Level()));
+        effective_msg.set_line(msg.Location().line);
+        effective_msg.set_file_name(msg.Location().file_name.data(), msg.Location().file_name.size());
+        effective_msg.set_func_name(msg.Location().fun_name.data(), msg.Location().fun_name.size());
+    }
+
+    if (msg.args.empty()) {
+        effective_msg.set_log_info(msg.message.data(), msg.message.size());
+    } else {
+        // 二进制sink不做格式化，格式串和参数原样落盘，由解码端还原
+        if (!has_site) {
+            effective_msg.set_log_fmt(msg.message.data(), msg.message.size());
+        }
+        effective_msg.set_log_args(msg.args.data(), msg.args.size());
+    }
+
+    size_t len = effective_msg.ByteSizeLong();
+    dest->resize(len);
+    effective_msg.SerializeToArray(dest->data(), len);
+}
+
+void EffectiveFormatter::FormatSite(const LogMsg& msg, MemoryBuffer* dest) {
+    EffectiveMsg effective_msg;
+    EffectiveSite* site = effective_msg.mutable_site();
+    site->set_log_id(msg.site->Id());
+    site->set_level(static_cast<int>(msg.Level()));
+    site->set_line(msg.Location().line);
+    site->set_file_name(msg.Location().file_name.data(), msg.Location().file_name.size());
+    site->set_func_name(msg.Location().fun_name.data(), msg.Location().fun_name.size());
+    if (!msg.args.empty()) {
+        site->set_log_fmt(msg.message.data(), msg.message.size());
+    }
 
     size_t len = effective_msg.ByteSizeLong();
     dest->resize(len);
     effective_msg.SerializeToArray(dest->data(), len);
 }
-}  // namespace logger
\ No newline at end of file
+}  // namespace logger
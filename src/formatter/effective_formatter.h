@@ -12,5 +12,8 @@ public:
     EffectiveFormatter& operator=(EffectiveFormatter&& other) = default;
 
     void Format(const LogMsg& msg, MemoryBuffer* dest) override;
+
+    // 调用点目录项：级别、位置以及延迟格式化的格式串
+    static void FormatSite(const LogMsg& msg, MemoryBuffer* dest);
 };
 }  
\ No newline at end of file
@@ -0,0 +1,109 @@
+#include "log_args.h"
+
+#include <iterator>
+
+#include <fmt/args.h>
+#include <fmt/format.h>
+
+namespace logger {
+namespace detail {
+
+template <typename T>
+static bool ReadRaw(StringView args, size_t* offset, T* value) {
+    if (*offset + sizeof(T) > args.size()) {
+        return false;
+    }
+    memcpy(value, args.data() + *offset, sizeof(T));
+    *offset += sizeof(T);
+    return true;
+}
+
+bool FormatArgs(StringView fmt, StringView args, MemoryBuffer* dest) {
+    fmt::dynamic_format_arg_store<fmt::format_context> store;
+    size_t offset = 0;
+    while (offset < args.size()) {
+        auto type = static_cast<ArgType>(args[offset++]);
+        bool ok = false;
+        switch (type) {
+        case ArgType::kBool: {
+            bool value = false;
+            ok = ReadRaw(args, &offset, &value);
+            store.push_back(value);
+            break;
+        }
+        case ArgType::kChar: {
+            char value = 0;
+            ok = ReadRaw(args, &offset, &value);
+            store.push_back(value);
+            break;
+        }
+        case ArgType::kInt: {
+            int64_t value = 0;
+            ok = ReadRaw(args, &offset, &value);
+            store.push_back(value);
+            break;
+        }
+        case ArgType::kUInt: {
+            uint64_t value = 0;
+            ok = ReadRaw(args, &offset, &value);
+            store.push_back(value);
+            break;
+        }
+        case ArgType::kFloat: {
+            float value = 0;
+            ok = ReadRaw(args, &offset, &value);
+            store.push_back(value);
+            break;
+        }
+        case ArgType::kDouble: {
+            double value = 0;
+            ok = ReadRaw(args, &offset, &value);
+            store.push_back(value);
+            break;
+        }
+        case ArgType::kString: {
+            uint32_t len = 0;
+            ok = ReadRaw(args, &offset, &len) && offset + len <= args.size();
+            if (ok) {
+                // 参数缓冲区在格式化期间一直有效，这里只保存视图
+                store.push_back(fmt::string_view(args.data() + offset, len));
+                offset += len;
+            }
+            break;
+        }
+        case ArgType::kPointer: {
+            uint64_t value = 0;
+            ok = ReadRaw(args, &offset, &value);
+            store.push_back(reinterpret_cast<const void*>(static_cast<uintptr_t>(value)));
+            break;
+        }
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+
+    size_t origin_size = dest->size();
+    try {
+        fmt::vformat_to(std::back_inserter(*dest), fmt::string_view(fmt.data(), fmt.size()), store);
+    } catch (const fmt::format_error&) {
+        dest->resize(origin_size);
+        return false;
+    }
+    return true;
+}
+
+void FormatLogMessage(const LogMsg& msg, MemoryBuffer* dest) {
+    if (msg.args.empty()) {
+        dest->append(msg.message.data(), msg.message.size());
+        return;
+    }
+
+    if (!FormatArgs(msg.message, msg.args, dest)) {
+        // 格式化失败时保留原始格式串，避免整条日志丢失
+        dest->append(msg.message.data(), msg.message.size());
+    }
+}
+
+}  // namespace detail
+}  // namespace logger
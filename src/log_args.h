@@ -0,0 +1,89 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+#include "log_common.h"
+#include "log_msg.h"
+
+namespace logger {
+namespace detail {
+
+// 延迟格式化参数编码：[type:1][payload]
+// 数值按原始字节拷贝，字符串为 [len:4][bytes]
+// 其余类型 (long double、chrono、自定义 formatter 等) 的格式说明只对原类型有效，不能延迟，整条消息在调用线程上格式化
+enum class ArgType : uint8_t {
+    kBool = 0,
+    kChar,
+    kInt,
+    kUInt,
+    kFloat,
+    kDouble,
+    kString,
+    kPointer,
+};
+
+inline void AppendArgRaw(MemoryBuffer* dest, ArgType type, const void* data, size_t size) {
+    dest->push_back(static_cast<char>(type));
+    dest->append(static_cast<const char*>(data), size);
+}
+
+inline void AppendArgString(MemoryBuffer* dest, StringView str) {
+    uint32_t len = static_cast<uint32_t>(str.size());
+    AppendArgRaw(dest, ArgType::kString, &len, sizeof(len));
+    dest->append(str.data(), len);
+}
+
+template <typename T, typename U = std::decay_t<T>>
+inline constexpr bool kDeferrableArg = (std::is_integral_v<U> && sizeof(U) <= sizeof(uint64_t)) ||
+                                       std::is_same_v<U, float> || std::is_same_v<U, double> ||
+                                       std::is_convertible_v<const U&, StringView> || std::is_pointer_v<U>;
+
+template <typename... Args>
+inline constexpr bool kDeferrableArgs = (kDeferrableArg<Args> && ...);
+
+template <typename T>
+void EncodeArg(MemoryBuffer* dest, const T& arg) {
+    using U = std::decay_t<T>;
+    static_assert(kDeferrableArg<U>, "argument type cannot be deferred, format it on the calling thread");
+    if constexpr (std::is_same_v<T, char*> || std::is_same_v<T, const char*>) {
+        // 空指针输出 (null)，不能对空指针求长度；字符数组不会为空，走下面的字符串分支
+        AppendArgString(dest, arg ? StringView(arg) : StringView("(null)"));
+    } else if constexpr (std::is_same_v<U, bool>) {
+        AppendArgRaw(dest, ArgType::kBool, &arg, sizeof(arg));
+    } else if constexpr (std::is_same_v<U, char>) {
+        AppendArgRaw(dest, ArgType::kChar, &arg, sizeof(arg));
+    } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+        int64_t value = arg;
+        AppendArgRaw(dest, ArgType::kInt, &value, sizeof(value));
+    } else if constexpr (std::is_integral_v<U>) {
+        uint64_t value = arg;
+        AppendArgRaw(dest, ArgType::kUInt, &value, sizeof(value));
+    } else if constexpr (std::is_same_v<U, float>) {
+        AppendArgRaw(dest, ArgType::kFloat, &arg, sizeof(arg));
+    } else if constexpr (std::is_same_v<U, double>) {
+        AppendArgRaw(dest, ArgType::kDouble, &arg, sizeof(arg));
+    } else if constexpr (std::is_convertible_v<const U&, StringView>) {
+        AppendArgString(dest, StringView(arg));
+    } else {
+        uint64_t value = reinterpret_cast<uintptr_t>(arg);
+        AppendArgRaw(dest, ArgType::kPointer, &value, sizeof(value));
+    }
+}
+
+// 调用线程只做参数的二进制拷贝，不做任何数值到文本的转换
+template <typename... Args>
+void EncodeArgs(MemoryBuffer* dest, const Args&... args) {
+    dest->clear();
+    (EncodeArg(dest, args), ...);
+}
+
+// 按格式串还原消息，参数损坏或与格式串不匹配时返回false
+bool FormatArgs(StringView fmt, StringView args, MemoryBuffer* dest);
+
+// 输出消息正文，延迟格式化的消息在这里才真正格式化
+void FormatLogMessage(const LogMsg& msg, MemoryBuffer* dest);
+
+}  // namespace detail
+}  // namespace logger
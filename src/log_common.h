@@ -1,6 +1,9 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <string>
+#include <string_view>
 
 #define LOGGER_LEVEL_TRACE 0
 #define LOGGER_LEVEL_DEBUG 1
@@ -27,28 +30,62 @@ enum class LogLevel {
 
 #define LOGGER_ACTION_LEVEL LOGGER_LEVEL_TRACE
 
+// 调用点注册：日志宏的每个调用点首次输出日志时分配一个进程内唯一的ID，0 表示未注册
+// 二进制sink据此只落盘一次调用点的静态信息(文件、函数、行号、格式串)，之后的日志只携带ID
+inline uint32_t RegisterLogSite() {
+    static std::atomic<uint32_t> next_site_id{1};
+    return next_site_id.fetch_add(1, std::memory_order_relaxed);
+}
+
+// 提取路径中的文件名，参数为字面量时在编译期完成
+constexpr StringView SourceBasename(StringView path) {
+    size_t pos = path.find_last_of("/\\");
+    return pos == StringView::npos ? path : path.substr(pos + 1);
+}
+
 struct SourceLocation {
     constexpr SourceLocation() = default;
 
-    SourceLocation(StringView file_name_in, int32_t line_in, StringView fun_name_in)
-            : file_name{file_name_in}, line{line_in}, fun_name{fun_name_in} {
-        // 提取文件名
-        if (!file_name.empty()) {
-            size_t pos = file_name.rfind('/');
-            if (pos != StringView::npos) {
-                file_name = file_name.substr(pos + 1);
-            } else {
-                pos = file_name.rfind('\\');
-                if (pos != StringView::npos) {
-                    file_name = file_name.substr(pos + 1);
-                }
-            }
-        }
-    }
+    constexpr SourceLocation(StringView file_name_in, int32_t line_in, StringView fun_name_in)
+            : file_name{SourceBasename(file_name_in)}, line{line_in}, fun_name{fun_name_in} {}
 
     StringView file_name;
     int32_t line{0};
     StringView fun_name;
 };
 
+// 调用点描述：日志宏在每个调用点生成一个 static constexpr 实例，文件名在编译期截取
+// 日志路径上只传递它的指针，地址在进程内唯一且不变
+struct LogSite {
+    constexpr LogSite(const SourceLocation& location_in, LogLevel level_in) : location{location_in}, level{level_in} {}
+
+    constexpr LogSite(StringView file_name_in, int32_t line_in, StringView fun_name_in, LogLevel level_in)
+            : LogSite(SourceLocation{file_name_in, line_in, fun_name_in}, level_in) {}
+
+    LogSite(const LogSite& other) = delete;
+    LogSite& operator=(const LogSite& other) = delete;
+
+    // 首次调用时分配ID，只能对静态存储的调用点调用；临时构造的调用点保持未注册
+    uint32_t Register() const {
+        uint32_t id = site_id.load(std::memory_order_relaxed);
+        if (id == 0) {
+            // 多个线程同时首次调用时只有一个ID生效，其余的ID作废
+            uint32_t fresh = RegisterLogSite();
+            id = site_id.compare_exchange_strong(id, fresh, std::memory_order_relaxed) ? fresh : id;
+        }
+        return id;
+    }
+
+    uint32_t Id() const {
+        return site_id.load(std::memory_order_relaxed);
+    }
+
+    SourceLocation location;
+    LogLevel level;
+
+private:
+    // constexpr 实例中唯一可写的成员，含 mutable 成员的对象不会放进只读段
+    mutable std::atomic<uint32_t> site_id{0};
+};
+
 }  // namespace logger
\ No newline at end of file
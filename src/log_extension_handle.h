@@ -2,8 +2,12 @@
 
 #include "log_handle.h"
 
+#include <atomic>
+
 #include <fmt/core.h>
 
+#include "log_args.h"
+
 namespace logger {
 class ExtensionLogHandle : public LogHandle {
 public:
@@ -11,27 +15,62 @@ public:
     using LogHandle::LogHandle;
 
     // 扩展功能 提供日志的fmt的参数拼接能力
+    // 日志宏使用：site 必须是静态存储的调用点，首次输出时为它分配ID
+    template <typename... Args>
+    void Log(const LogSite* site, fmt::format_string<Args...> fmt, Args&&... args) {
+        if (!ShouldLog(site->level)) {
+            return;
+        }
+        site->Register();
+        Log_(site, fmt, std::forward<Args>(args)...);
+    }
+
     template <typename... Args>
     void Log(LogLevel level, SourceLocation loc, fmt::format_string<Args...> fmt, Args&&... args) {
-        Log_(level, loc, fmt, std::forward<Args>(args)...);
+        if (!ShouldLog(level)) {
+            return;
+        }
+        LogSite site(loc, level);
+        Log_(&site, fmt, std::forward<Args>(args)...);
     }
 
     template <typename... Args>
     void Log(LogLevel level, fmt::format_string<Args...> fmt, Args&&... args) {
-        Log(SourceLocation{}, level, fmt, std::forward<Args>(args)...);
+        Log(level, SourceLocation{}, fmt, std::forward<Args>(args)...);
+    }
+
+    // 延迟格式化：调用线程只拷贝格式串指针和参数的二进制，格式化交给sink
+    // 开启后格式串必须是字面量等静态存储的字符串；数值、字符串、指针以外的参数类型仍在调用线程上格式化
+    void SetDeferredFormat(bool enable) {
+        deferred_format_.store(enable, std::memory_order_relaxed);
+    }
+
+    bool IsDeferredFormat() const {
+        return deferred_format_.load(std::memory_order_relaxed);
     }
 
 private:
     template <typename... Args>
-    void Log_(LogLevel level, SourceLocation loc, fmt::format_string<Args...> fmt, Args&&... args) {
-        if (!ShouldLog(level)) {
-            return;
+    void Log_(const LogSite* site, fmt::format_string<Args...> fmt, Args&&... args) {
+        // 有不能延迟的参数类型时整条消息照常格式化，参见 detail::kDeferrableArg
+        if constexpr (sizeof...(Args) > 0 && detail::kDeferrableArgs<Args...>) {
+            if (IsDeferredFormat()) {
+                static thread_local MemoryBuffer fmt_args;
+                detail::EncodeArgs(&fmt_args, args...);
+                fmt::string_view fmt_str = fmt;
+                LogMsg msg(site, StringView(fmt_str.data(), fmt_str.size()), fmt_args);
+                LogHandle::Log_(msg);
+                return;
+            }
         }
 
         // 将格式化后的内容生成到 std::string，作为消息体传递
         std::string formatted = fmt::format(fmt, std::forward<Args>(args)...);
-        LogMsg msg(loc, level, StringView(formatted.data(), formatted.size()));
+        LogMsg msg(site, StringView(formatted.data(), formatted.size()));
         LogHandle::Log_(msg);
     }
+
+private:
+    std::atomic<bool> deferred_format_{false};
 };
 }  // namespace logger
\ No newline at end of file
@@ -23,11 +23,22 @@ LogLevel LogHandle::GetLevel() const {
     return level_;
 }
 
+void LogHandle::Log(const LogSite* site, StringView message) {
+    if (!ShouldLog(site->level)) {
+        return;
+    }
+    site->Register();
+    LogMsg msg(site, message);
+    Log_(msg);
+}
+
 void LogHandle::Log(LogLevel level, SourceLocation loc, StringView message) {
     if (!ShouldLog(level)) {
         return;
     }
-    LogMsg msg(loc, level, message);
+    // 临时的调用点不注册ID，sink 按没有调用点目录的方式输出
+    LogSite site(loc, level);
+    LogMsg msg(&site, message);
     Log_(msg);
 }
 
@@ -22,7 +22,7 @@ public:
     explicit LogHandle(LogSinkPtr sink);
 
     template <typename It>
-    LogHandle(It begin, It end) {
+    LogHandle(It begin, It end) : level_(LogLevel::kInfo) {
         sinks_ = std::vector<LogSinkPtr>(begin, end);
     }
 
@@ -35,6 +35,9 @@ public:
 
     LogLevel GetLevel() const;
 
+    // 日志宏使用：site 必须是静态存储的调用点，首次输出时为它分配ID
+    void Log(const LogSite* site, StringView message);
+
     void Log(LogLevel level, SourceLocation loc, StringView message);
 
 protected:
@@ -4,15 +4,25 @@
 
 namespace logger {
 struct LogMsg {
-    LogMsg(SourceLocation loc, LogLevel lvl, StringView mes)
-            : location(std::move(loc)), level(std::move(lvl)), message(std::move(mes)) {}
-    LogMsg(LogLevel lvl, StringView mes) : LogMsg(SourceLocation{}, lvl, mes) {}
+    LogMsg(const LogSite* site_in, StringView mes) : site(site_in), message(std::move(mes)) {}
+    LogMsg(const LogSite* site_in, StringView fmt, StringView fmt_args)
+            : site(site_in), message(std::move(fmt)), args(std::move(fmt_args)) {}
 
     LogMsg(const LogMsg& other) = default;
     LogMsg& operator=(const LogMsg& other) = default;
 
-    SourceLocation location;
-    LogLevel level;
+    const SourceLocation& Location() const {
+        return site->location;
+    }
+
+    LogLevel Level() const {
+        return site->level;
+    }
+
+    // 调用点描述，包含位置和级别，日志宏生成的为静态常量，只在本次 Log 调用期间有效
+    const LogSite* site;
     StringView message;
+    // 延迟格式化的参数编码，非空时message为格式串，参见 log_args.h
+    StringView args;
 };
 };  // namespace logger
\ No newline at end of file
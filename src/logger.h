@@ -6,11 +6,12 @@
 
 #define EXT_LOGGER_INIT(handle) logger::LogFactory::GetInstacne().SetLogHandle(handle)
 
-#define LOGGER_CALL(handle, level, ...)                                                                   \
-    if (handle) {                                                                                         \
-        (handle)->Log(level,                                                                              \
-                      logger::SourceLocation{__FILE__, __LINE__, static_cast<const char*>(__FUNCTION__)}, \
-                      __VA_ARGS__);                                                                       \
+// 调用点的文件名、行号、函数名和级别在编译期确定，只把描述的指针传给日志实例
+#define LOGGER_CALL(handle, level, ...)                                                                          \
+    if (handle) {                                                                                                \
+        static constexpr logger::LogSite logger_site{__FILE__, __LINE__, static_cast<const char*>(__FUNCTION__), \
+                                                     level};                                                     \
+        (handle)->Log(&logger_site, __VA_ARGS__);                                                                \
     }
 
 #if LOGGER_ACTIVE_LEVEL <= LOGGER_LEVEL_TRACE
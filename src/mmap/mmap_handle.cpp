@@ -1,24 +1,43 @@
 #include "mmap_handle.h"
 
 #include <algorithm>
+#include <cerrno>
+#include <fstream>
 #include <string.h>
+#include <thread>
 
 #include "utils/sys_util.h"
+#include "internal_log.h"
 
 namespace logger {
 
-constexpr size_t kDefaultCapacity = 512 * 1024;  // 默认大小 512k
+static constexpr uint32_t kCommitSpins = 64;  // 等待前面的写者提交时先自旋，超过后让出CPU
 
-MMapHandle::MMapHandle(fpath file_path) : file_path_(std::move(file_path)), handle_(nullptr), capacity_(0) {
-    size_t file_size = fs::GetFileSize(file_path);
-    size_t set_capacity_size = std::max(file_size, kDefaultCapacity);
+MMapHandle::MMapHandle(fpath file_path, size_t capacity, size_t reserve)
+        : MMapHandle(std::move(file_path), Options{capacity, reserve}) {}
+
+MMapHandle::MMapHandle(fpath file_path, const Options& options)
+        : file_path_(std::move(file_path)),
+          handle_(nullptr),
+          capacity_(0),
+          fd_(-1),
+          options_(options),
+          reserved_(0),
+          written_back_(0),
+          synced_(0) {
+    size_t file_size = fs::GetFileSize(file_path_);
+    size_t set_capacity_size = std::max(file_size, options_.capacity);
 
     // 初始化一定会触发扩容 mmap映射
-    Reserve(set_capacity_size);
+    ReserveCapacity(set_capacity_size);
 
     Init();
 }
 
+MMapHandle::~MMapHandle() {
+    Close();
+}
+
 MMapHandle::MMapHeader* MMapHandle::Header() const {
     if (!handle_) {
         return nullptr;
@@ -39,6 +58,24 @@ uint8_t* MMapHandle::Data() const {
     return static_cast<uint8_t*>(handle_) + sizeof(MMapHeader);
 }
 
+uint8_t* MMapHandle::Meta() const {
+    if (!IsValid()) {
+        return nullptr;
+    }
+
+    return Header()->meta;
+}
+
+bool MMapHandle::Recognized(const fpath& file_path) {
+    std::ifstream ifs(file_path, std::ios::binary);
+    uint32_t magic = 0;
+    if (!ifs.read(reinterpret_cast<char*>(&magic), sizeof(magic))) {
+        return true;
+    }
+    // 新建的文件还没有写入文件头，全为0
+    return magic == 0 || magic == MMapHeader::kMagic;
+}
+
 void MMapHandle::Init() {
     MMapHeader* header = Header();
     if (!header) {
@@ -46,7 +83,20 @@ void MMapHandle::Init() {
     }
     if (header->magic != MMapHeader::kMagic) {
         header->magic = MMapHeader::kMagic;
+        header->flags = 0;
         header->size = 0;
+        header->committed = 0;
+        memset(header->meta, 0, sizeof(header->meta));
+        return;
+    }
+
+    // 上次退出时还有写者没提交，未提交的部分内容不完整，只保留连续提交的前缀
+    if (header->committed != header->size) {
+        LOG_ERROR("MMapHandle: {} uncommitted size={}, committed={}",
+                  file_path_.string(),
+                  header->size.load(),
+                  header->committed.load());
+        header->size = header->committed.load();
     }
 }
 
@@ -55,15 +105,19 @@ bool MMapHandle::Resize(size_t new_size) {
         return false;
     }
     size_t need_capacity = sizeof(MMapHeader) + new_size;
+    written_back_ = std::min(written_back_, new_size);
+    synced_ = std::min(synced_, new_size);
 
     if (need_capacity < capacity_) {  // 容量未满无需扩容, 只调整size大小
         Header()->size = new_size;
+        Header()->committed = new_size;
         return true;
     }
 
     // 容量满了 调整capacity
-    if (Reserve(need_capacity)) {  // 超出容量，扩容
+    if (ReserveCapacity(need_capacity)) {  // 超出容量，扩容
         Header()->size = new_size;
+        Header()->committed = new_size;
         return true;
     }
 
@@ -79,51 +133,161 @@ size_t MMapHandle::Size() const {
 }
 
 bool MMapHandle::Push(const void* data, size_t data_size) {
-    if (!IsValid()) {
+    Span span{data, data_size};
+    return PushV(&span, 1);
+}
+
+bool MMapHandle::PushV(const Span* spans, size_t count) {
+    size_t total = 0;
+    for (size_t i = 0; i < count; ++i) {
+        total += spans[i].size;
+    }
+
+    uint8_t* dest = Reserve(total);
+    if (!dest) {
         return false;
     }
 
-    size_t need_capacity = sizeof(MMapHeader) + Header()->size + data_size;
+    for (size_t i = 0; i < count; ++i) {
+        if (spans[i].size) {
+            memcpy(dest, spans[i].data, spans[i].size);
+            dest += spans[i].size;
+        }
+    }
+    Advance(total);
+    return true;
+}
+
+uint8_t* MMapHandle::Reserve(size_t size) {
+    if (!IsValid()) {
+        return nullptr;
+    }
 
-    if (Reserve(need_capacity)) {
-        memcpy(Data() + Size(), data, data_size);
+    size_t need_capacity = sizeof(MMapHeader) + Header()->size + size;
+    if (!ReserveCapacity(need_capacity)) {
+        return nullptr;
+    }
+    return Data() + Size();
+}
+
+void MMapHandle::Advance(size_t size) {
+    Header()->size += size;
+    Header()->committed += size;
+}
+
+uint8_t* MMapHandle::Claim(size_t size) {
+    if (!IsValid()) {
+        return nullptr;
+    }
+
+    // CAS 而不是 fetch_add，空间不足时不会把 size 推过容量
+    MMapHeader* header = Header();
+    size_t limit = capacity_ - sizeof(MMapHeader);
+    uint64_t offset = header->size.load(std::memory_order_relaxed);
+    do {
+        if (offset + size > limit) {
+            return nullptr;
+        }
+    } while (!header->size.compare_exchange_weak(offset, offset + size, std::memory_order_relaxed));
+
+    return Data() + offset;
+}
 
-        Header()->size += data_size;
+void MMapHandle::Commit(const uint8_t* claimed, size_t size) {
+    MMapHeader* header = Header();
+    uint64_t offset = claimed - Data();
+    // 前面预留的写者还没提交时等待，写者持有锁串行写入时不会等待
+    for (uint32_t spin = 0; header->committed.load(std::memory_order_acquire) != offset; ++spin) {
+        if (spin >= kCommitSpins) {
+            std::this_thread::yield();
+        }
+    }
+    header->committed.store(offset + size, std::memory_order_release);
+}
+
+bool MMapHandle::Committed() const {
+    if (!IsValid()) {
         return true;
     }
 
-    return false;
+    MMapHeader* header = Header();
+    return header->committed.load(std::memory_order_acquire) == header->size.load(std::memory_order_acquire);
 }
 
 void MMapHandle::Clear() {
     if (!IsValid()) {
         return;
     }
+    Header()->flags = 0;
     Header()->size = 0;
+    Header()->committed = 0;
+    written_back_ = 0;
+    synced_ = 0;
+}
+
+void MMapHandle::SealOnCrash(const void* tail, size_t tail_size) {
+    MMapHeader* header = Header();
+    if (!header || header->magic != MMapHeader::kMagic) {
+        return;
+    }
+    // 已提交的部分是连续的前缀，之后预留的空间可能只写了一半
+    uint64_t size = header->committed.load(std::memory_order_acquire);
+    if (tail_size > 0 && sizeof(MMapHeader) + size + tail_size <= capacity_) {
+        memcpy(static_cast<uint8_t*>(handle_) + sizeof(MMapHeader) + size, tail, tail_size);
+        size += tail_size;
+    }
+    header->size.store(size, std::memory_order_relaxed);
+    header->committed.store(size, std::memory_order_relaxed);
+    header->flags.fetch_or(MMapHeader::kSealed, std::memory_order_release);
+}
+
+bool MMapHandle::Sealed() const {
+    MMapHeader* header = Header();
+    return header && (header->flags.load(std::memory_order_acquire) & MMapHeader::kSealed);
+}
+
+bool MMapHandle::Sync(size_t size, bool wait) {
+    if (fd_ == -1) {
+        return false;
+    }
+    // 发起回写和等待落盘分别记录位置，只发起过回写的数据等待落盘时还要再同步一次
+    size_t& mark = wait ? synced_ : written_back_;
+    if (size == mark) {
+        return true;
+    }
+
+    // 追加写入的脏页都在上次同步的位置之后
+    size_t offset = std::min(mark, size);
+    if (!SyncFile(sizeof(MMapHeader) + offset, size - offset, wait)) {
+        LOG_ERROR("file {} sync {} bytes fail: {}", file_path_.string(), size - offset, errno);
+        return false;
+    }
+    mark = size;
+    if (wait) {
+        written_back_ = size;
+    }
+    return true;
 }
 
 size_t MMapHandle::GetValidCapacity(size_t size) {  // capacity 向上取虚拟内存页面倍数
 
-    size_t page_size = GetPageSize();
+    size_t page_size = options_.huge_pages ? kHugePageSize : GetPageSize();
     // 向上取虚拟内存页面倍数
     return ((size + page_size - 1) / page_size) * page_size;
 }
 
-bool MMapHandle::Reserve(size_t target_capacity) {
+bool MMapHandle::ReserveCapacity(size_t target_capacity) {
     // target_capacity 向上取虚拟内存页面倍数
     target_capacity = GetValidCapacity(target_capacity);
 
-    if (target_capacity < capacity_) {
+    if (target_capacity <= capacity_) {
         return true;
     }
 
     size_t old_capacity = capacity_;
-    target_capacity = old_capacity + std::max(old_capacity, target_capacity);  // 扩容策略 follow vector 策略
-
-    // 解除映射
-    Unmap();
+    target_capacity = std::max(2 * old_capacity, target_capacity);  // 扩容策略 follow vector 策略，一次需要更多时扩到所需大小
 
-    // 重新mmap新大小
+    // 在原映射上扩展，已映射的页不会被拆除重建
     if (TryMap(target_capacity)) {
         capacity_ = target_capacity;
         return true;
@@ -132,6 +296,27 @@ bool MMapHandle::Reserve(size_t target_capacity) {
     return false;
 }
 
+bool MMapHandle::Reallocate(size_t capacity) {
+    if (!IsValid()) {
+        return false;
+    }
+
+    capacity = GetValidCapacity(std::max(capacity, sizeof(MMapHeader) + Size()));
+    if (capacity == capacity_) {
+        return true;
+    }
+
+    if (capacity > capacity_) {
+        if (!TryMap(capacity)) {
+            return false;
+        }
+    } else if (!TryShrink(capacity)) {
+        return false;
+    }
+    capacity_ = capacity;
+    return true;
+}
+
 bool MMapHandle::IsValid() const {
     MMapHeader* header = Header();
     if (!header) {
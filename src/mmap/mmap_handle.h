@@ -1,22 +1,48 @@
 #pragma once
+#include <atomic>
+
 #include "utils/file_util.h"
 
 namespace logger {
 
 class MMapHandle {
 public:
-    MMapHandle(fpath file_path);
+    static constexpr size_t kMetaCapacity = 240;  // 使用者元数据区大小
+
+    static constexpr size_t kDefaultCapacity = 512 * 1024;  // 默认大小 512k
+
+    static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+
+    struct Span {
+        const void* data;
+        size_t size;
+    };
+
+    struct Options {
+        size_t capacity = kDefaultCapacity;  // 初始映射大小，已有文件更大时按文件大小映射
+        size_t reserve = 0;       // 大于 capacity 时预留这么大的连续虚拟地址，扩容不超过预留范围时映射地址不变
+        bool populate = false;    // 映射后立即建立页表，写入路径上不再缺页
+        bool huge_pages = false;  // 容量按大页对齐并建议内核使用大页，文件需要位于 tmpfs 或 hugetlbfs 上才有效果
+    };
+
+    explicit MMapHandle(fpath file_path, size_t capacity = kDefaultCapacity, size_t reserve = 0);
+
+    MMapHandle(fpath file_path, const Options& options);
 
     MMapHandle(const MMapHandle& other) = delete;
     MMapHandle& operator=(const MMapHandle& other) = delete;
 
-    MMapHandle(MMapHandle&& other) = default;
-    MMapHandle& operator=(MMapHandle&& other) = default;
+    // 持有文件描述符和映射，不支持移动
+    MMapHandle(MMapHandle&& other) = delete;
+    MMapHandle& operator=(MMapHandle&& other) = delete;
 
-    ~MMapHandle() = default;
+    ~MMapHandle();
 
     uint8_t* Data() const;
 
+    // 使用者自定义的元数据，与数据一起持久化，Clear 不会清除
+    uint8_t* Meta() const;
+
     bool Resize(size_t new_size);
 
     size_t Size() const;
@@ -25,22 +51,77 @@ public:
         return capacity_;
     }
 
+    // 单写者追加，容量不足时扩容，不能与 Claim 并发使用
     bool Push(const void* data, size_t data_size);
 
+    // 多段数据一次预留、连续写入
+    bool PushV(const Span* spans, size_t count);
+
+    // 单写者：返回末尾至少 size 字节的可写空间，容量不足时扩容，失败返回 nullptr
+    // 使用者直接在这段空间上生成数据，再用 Advance 发布实际写入的大小，之前的指针在下次扩容后失效
+    uint8_t* Reserve(size_t size);
+
+    void Advance(size_t size);
+
+    // 多写者追加：原子地预留一段 size 字节的空间，写完后调用 Commit 发布
+    // 只在当前容量内预留，不会扩容，空间不足返回 nullptr；预留期间不能调用 Push/Resize/Clear
+    uint8_t* Claim(size_t size);
+
+    // 按预留的顺序发布：等前面预留的空间都提交后才推进已提交的位置，已提交的部分始终是连续的前缀，
+    // 重新打开或崩溃封存时可以直接按它截断；claimed 为 Claim 返回的指针
+    void Commit(const uint8_t* claimed, size_t size);
+
+    // 所有预留的空间是否都已提交，落盘前需要等到这里为 true
+    bool Committed() const;
+
     void Clear();
 
+    // 把映射容量调整到 capacity，不会小于已有数据，缩小时同时归还文件空间；预留期间不能调用
+    bool Reallocate(size_t capacity);
+
     bool Empty() const {
         return Size() == 0;
     }
 
     double GetRatio() const;
 
+    // 映射文件的描述符和数据在文件中的偏移，落盘时由内核直接从文件拷贝数据
+    int Fd() const {
+        return fd_;
+    }
+
+    static constexpr size_t DataOffset() {
+        return sizeof(MMapHeader);
+    }
+
+    // 把上次同步之后追加到 size 的数据连同文件头写回磁盘，没有新数据时直接返回
+    // wait 为 false 时只对这段脏页发起回写，不等待；为 true 时等待落盘 (fdatasync)
+    // 只使用文件描述符，不访问映射，可以与写入和扩容并发；调用方保证与 Clear/Resize 互斥
+    bool Sync(size_t size, bool wait);
+
+    // 崩溃时在信号处理函数中调用：丢弃未提交的部分，在已提交的数据后追加 tail (空间不够时不追加)，
+    // 再把文件头标记为已封存；只访问映射，不加锁不分配内存，异步信号安全
+    void SealOnCrash(const void* tail, size_t tail_size);
+
+    // 文件不存在、为空或文件头是本格式时返回 true；其他格式的文件 (例如旧版本的缓存) 打开后会被清空，调用方应先检查
+    static bool Recognized(const fpath& file_path);
+
+    // 上次进程崩溃时已封存；Clear 后清除
+    bool Sealed() const;
+
 private:
     struct MMapHeader {
-        static constexpr uint32_t kMagic = 0xdeadbeef;
+        static constexpr uint32_t kMagic = 0xdeadbef1;
+        static constexpr uint32_t kSealed = 1;
         uint32_t magic = kMagic;
-        size_t size;  // 存储数据大小
+        std::atomic<uint32_t> flags;      // 原来的对齐填充，旧文件中为0
+        std::atomic<uint64_t> size;       // 已预留的数据大小
+        std::atomic<uint64_t> committed;  // 连续提交到的位置，等于 size 时数据完整
+        uint8_t meta[kMetaCapacity];      // 使用者元数据
     };
+    static_assert(std::atomic<uint64_t>::is_always_lock_free, "mmap header requires lock free atomics");
+    static_assert(std::atomic<uint32_t>::is_always_lock_free, "mmap header requires lock free atomics");
+    static_assert(sizeof(MMapHeader) == 24 + kMetaCapacity, "mmap header layout changed");
 
     fpath file_path_;
 
@@ -48,6 +129,14 @@ private:
 
     size_t capacity_;
 
+    int fd_;  // 映射文件的描述符，整个生命周期内保持打开，扩容不再重新打开文件
+
+    Options options_;
+    size_t reserved_;  // 实际预留的虚拟地址大小，0 表示没有预留
+
+    size_t written_back_;  // 已经发起回写的数据大小
+    size_t synced_;        // 已经确认落盘的数据大小
+
 private:
     MMapHeader* Header() const;
 
@@ -55,13 +144,28 @@ private:
 
     size_t GetValidCapacity(size_t size);
 
-    bool Reserve(size_t target_capacity);
+    bool ReserveCapacity(size_t target_capacity);
 
+    // 映射或把已有映射扩展到 capacity，文件先分配好磁盘空间
     bool TryMap(size_t capacity);
 
+    bool Allocate(size_t capacity);
+
+    // 解除 capacity 之后的映射并截断文件，预留的虚拟地址保持预留
+    bool TryShrink(size_t capacity);
+
+    // 预留一段对齐的虚拟地址，返回 nullptr 表示失败
+    void* ReserveAddress(size_t size, size_t alignment);
+
+    // 对 [offset, capacity) 的新映射应用 populate/huge_pages 选项
+    void Advise(size_t offset, size_t capacity);
+
     void Unmap();
 
-    void Sync();  // 落盘
+    void Close();
+
+    // 同步文件头和数据区 [offset, offset + length)
+    bool SyncFile(size_t offset, size_t length, bool wait);
 
     bool IsValid() const;
 };
@@ -1,46 +1,201 @@
 #include "mmap_handle.h"
 
+#include <algorithm>
+
+#include <errno.h>
 #include <fcntl.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 #include "internal_log.h"
-#include "defer.h"
 
 namespace logger {
 
 bool MMapHandle::TryMap(size_t capacity) {
-    // 获取映射文件句柄 没有映射文件创建一个 （不覆盖）
-    int fd = open(file_path_.string().c_str(), O_RDWR | O_CREAT, S_IRWXU);
-    DEFER {
-        if (fd) {
-            close(fd);
+    if (fd_ == -1) {
+        // 获取映射文件句柄 没有映射文件创建一个 （不覆盖）
+        fd_ = open(file_path_.string().c_str(), O_RDWR | O_CREAT | O_CLOEXEC, S_IRWXU);
+        if (fd_ == -1) {
+            LOG_ERROR("open file {} error: {}", file_path_.string(), errno);
+            return false;
         }
-    };
-    if (fd == -1) {
-        LOG_ERROR("open file {} error: {}", file_path_.string(), fd);
+    }
+
+    if (!Allocate(capacity)) {
         return false;
     }
 
-    if (ftruncate(fd, capacity) == -1) {  // 设置文件为capacity大小
-        LOG_ERROR("file {} resize {} fail", file_path_.string(), capacity);
+    int populate = options_.populate ? MAP_POPULATE : 0;
+    if (!handle_) {
+        if (options_.reserve > capacity || options_.huge_pages) {
+            // 先预留一段不可访问的地址，文件映射覆盖在它的开头，后续扩容在预留范围内原地进行
+            // 大页要求映射地址按大页对齐，也从对齐的预留地址开始
+            size_t reserve = std::max(options_.reserve, capacity);
+            void* base = ReserveAddress(reserve, options_.huge_pages ? kHugePageSize : 0);
+            if (base) {
+                void* addr = mmap(base, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | populate, fd_, 0);
+                if (addr != MAP_FAILED) {
+                    handle_ = addr;
+                    reserved_ = reserve;
+                    Advise(0, capacity);
+                    return true;
+                }
+                munmap(base, reserve);
+            }
+        }
+
+        void* addr = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED | populate, fd_, 0);  // 进行内存映射
+        if (addr == MAP_FAILED) {
+            LOG_ERROR("file {} mmap {} fail: {}", file_path_.string(), capacity, errno);
+            return false;
+        }
+        handle_ = addr;
+        Advise(0, capacity);
+        return true;
+    }
+
+    if (capacity <= reserved_) {  // 只映射新增的部分，地址不变
+        void* tail = static_cast<uint8_t*>(handle_) + capacity_;
+        void* addr = mmap(
+                tail, capacity - capacity_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED | populate, fd_, capacity_);
+        if (addr == MAP_FAILED) {
+            LOG_ERROR("file {} extend mmap {} fail: {}", file_path_.string(), capacity, errno);
+            return false;
+        }
+        Advise(capacity_, capacity);
+        return true;
+    }
+
+    if (reserved_ > capacity_) {  // 超出预留范围，剩余的预留地址先归还，之后按普通映射扩容
+        munmap(static_cast<uint8_t*>(handle_) + capacity_, reserved_ - capacity_);
+    }
+    reserved_ = 0;
+
+    // 内核直接搬移页表，不需要拆除已有映射再重新缺页
+    void* addr = mremap(handle_, capacity_, capacity, MREMAP_MAYMOVE);
+    if (addr == MAP_FAILED) {
+        LOG_ERROR("file {} mremap {} fail: {}", file_path_.string(), capacity, errno);
         return false;
     }
+    handle_ = addr;
+    Advise(capacity_, capacity);
+    return true;
+}
 
-    handle_ = mmap(NULL, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);  // 进行内存映射
-    return handle_ != MAP_FAILED;
+bool MMapHandle::TryShrink(size_t capacity) {
+    uint8_t* tail = static_cast<uint8_t*>(handle_) + capacity;
+    size_t length = capacity_ - capacity;
+    if (reserved_) {  // 换回不可访问的匿名映射，地址仍属于预留范围，之后可以原地扩容
+        void* addr = mmap(tail, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+        if (addr == MAP_FAILED) {
+            LOG_ERROR("file {} shrink mmap {} fail: {}", file_path_.string(), capacity, errno);
+            return false;
+        }
+    } else if (munmap(tail, length) == -1) {
+        LOG_ERROR("file {} shrink munmap {} fail: {}", file_path_.string(), capacity, errno);
+        return false;
+    }
+
+    if (ftruncate(fd_, capacity) == -1) {
+        LOG_ERROR("file {} truncate {} fail: {}", file_path_.string(), capacity, errno);
+    }
+    return true;
+}
+
+void* MMapHandle::ReserveAddress(size_t size, size_t alignment) {
+    size_t length = size + alignment;
+    void* base = mmap(NULL, length, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (base == MAP_FAILED) {
+        return nullptr;
+    }
+    if (!alignment) {
+        return base;
+    }
+
+    // 多预留一个对齐单位，再把首尾多出来的部分归还
+    uintptr_t start = reinterpret_cast<uintptr_t>(base);
+    uintptr_t aligned = (start + alignment - 1) & ~(alignment - 1);
+    if (aligned > start) {
+        munmap(base, aligned - start);
+    }
+    size_t tail = start + length - (aligned + size);
+    if (tail) {
+        munmap(reinterpret_cast<void*>(aligned + size), tail);
+    }
+    return reinterpret_cast<void*>(aligned);
+}
+
+void MMapHandle::Advise(size_t offset, size_t capacity) {
+    uint8_t* addr = static_cast<uint8_t*>(handle_) + offset;
+    size_t length = capacity - offset;
+#ifdef MADV_HUGEPAGE
+    if (options_.huge_pages) {  // 内核或文件系统不支持时忽略
+        madvise(addr, length, MADV_HUGEPAGE);
+    }
+#endif
+
+    if (options_.populate) {
+        // MAP_POPULATE 对共享映射只建立只读页表，第一次写入仍有一次写保护缺页，这里按写入预先缺页
+#ifdef MADV_POPULATE_WRITE
+        if (madvise(addr, length, MADV_POPULATE_WRITE) == 0) {
+            return;
+        }
+#endif
+        madvise(addr, length, MADV_WILLNEED);
+    }
+}
+
+// 提前分配磁盘块，磁盘满时在这里返回失败，而不是写入映射页时收到 SIGBUS
+bool MMapHandle::Allocate(size_t capacity) {
+    if (fallocate(fd_, 0, 0, capacity) == 0) {
+        return true;
+    }
+
+    if (errno != EOPNOTSUPP) {
+        LOG_ERROR("file {} fallocate {} fail: {}", file_path_.string(), capacity, errno);
+        return false;
+    }
+
+    // 文件系统不支持 fallocate，只调整文件大小
+    struct stat st;
+    if (fstat(fd_, &st) == 0 && static_cast<size_t>(st.st_size) >= capacity) {
+        return true;
+    }
+    if (ftruncate(fd_, capacity) == -1) {  // 设置文件为capacity大小
+        LOG_ERROR("file {} resize {} fail", file_path_.string(), capacity);
+        return false;
+    }
+    return true;
 }
 
 void MMapHandle::Unmap() {
     if (handle_) {
-        munmap(handle_, capacity_);
+        munmap(handle_, std::max(capacity_, reserved_));
     }
     handle_ = NULL;
+    reserved_ = 0;
 }
 
-void MMapHandle::Sync() {
-    if (handle_) {
-        msync(handle_, capacity_, MS_SYNC);
+void MMapHandle::Close() {
+    Unmap();
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
     }
-}  // 页面缓存落盘
-}  // namespace logger
\ No newline at end of file
+}
+
+bool MMapHandle::SyncFile(size_t offset, size_t length, bool wait) {
+    if (wait) {
+        // 映射写入的脏页也在页缓存中，fdatasync 只写回脏页，同时提交 fallocate 分配的块从未写入到已写入的转换
+        return fdatasync(fd_) == 0;
+    }
+
+    // msync(MS_ASYNC) 在 Linux 上不做任何事，这里直接对脏页范围发起回写，文件头记录了数据大小，一起回写
+    if (sync_file_range(fd_, 0, sizeof(MMapHeader), SYNC_FILE_RANGE_WRITE) == -1) {
+        return false;
+    }
+    return length == 0 || sync_file_range(fd_, offset, length, SYNC_FILE_RANGE_WRITE) == 0;
+}
+
+}  // namespace logger
@@ -1,28 +1,140 @@
 #include "effective_sink.h"
 
 #include "sys_util.h"
+#include "crc32c.h"
 
+#include <algorithm>
 #include <tuple>
+#include <cerrno>
+#include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <thread>
 
 #include "internal_log.h"
 #include "effective_formatter.h"
 #include "aes_crypt.h"
+#include "aes_ctr_crypt.h"
 #include "timer_count.h"
 
 namespace logger {
-EffectiveSink::EffectiveSink(const Config& conf) : conf_(std::move(conf)) {
-    LOG_INFO("EffectiveSink: dir={}, prefix={}, pub_key={}, interval={}, single_size={}, total_size={}",
+namespace detail {
+// 暂存环中每条记录的头部
+struct StageHeader {
+    enum Kind : uint32_t {
+        kRecord = 0,        // 序列化后的日志
+        kDeferredRecord,    // 延迟格式化的日志，目录项需要带格式串
+        kSite,              // 调用点目录项
+        kSiteWithFmt,       // 带格式串的调用点目录项
+    };
+    uint32_t site_id;
+    uint32_t kind;
+};
+
+// 每个生产者线程在每个sink上独占一个暂存环
+struct StagingProducer {
+    explicit StagingProducer(size_t capacity) : ring(capacity) {}
+
+    // 该线程是否已经把调用点目录项交给消费者：0 未提交 1 不带格式串 2 带格式串
+    bool NeedPublishSite(uint32_t site_id, bool need_fmt) {
+        if (site_id >= published_sites.size()) {
+            published_sites.resize(site_id + 1, 0);
+        }
+        uint8_t state = published_sites[site_id];
+        return state == 0 || (need_fmt && state != 2);
+    }
+
+    SpscRing ring;
+    std::vector<uint8_t> published_sites;
+    std::atomic<bool> closed{false};
+};
+
+// 压缩线程共用的压缩器，数量与压缩线程数相同，同时运行的任务不会超过压缩器数量
+class CompressorPool {
+public:
+    void Add(std::unique_ptr<compress::Compression> compressor) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        compressors_.push_back(std::move(compressor));
+    }
+
+    std::unique_ptr<compress::Compression> Acquire() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (compressors_.empty()) {
+            return nullptr;
+        }
+        auto compressor = std::move(compressors_.back());
+        compressors_.pop_back();
+        return compressor;
+    }
+
+    void Release(std::unique_ptr<compress::Compression> compressor) {
+        Add(std::move(compressor));
+    }
+
+private:
+    std::mutex mutex_;
+    std::vector<std::unique_ptr<compress::Compression>> compressors_;
+};
+}  // namespace detail
+
+// 暂存环的兜底排空间隔，生产者错过唤醒时最多延迟这么久
+static constexpr std::chrono::milliseconds kStagingDrainInterval{10};
+
+// 每个缓存段预留的虚拟地址是段大小的倍数，段超出固定大小扩容时 (kSpill 或超大日志) 映射地址不变
+static constexpr size_t kSegmentReserveFactor = 16;
+
+// 启动时段环中遗留的数据改名为 {kRecoveryPrefix}{n}，由落盘线程在后台恢复
+static constexpr const char* kRecoveryPrefix = "recovery_";
+
+// 段环位置上格式不认识的文件改名为 {kUnrecognizedPrefix}{原文件名} 留在磁盘上，不清空也不删除
+static constexpr const char* kUnrecognizedPrefix = "unrecognized_";
+
+static std::atomic<uint64_t> next_sink_id{1};
+
+// 开启了 crash_hook 的sink，信号处理函数中只能无锁访问
+static constexpr size_t kMaxCrashSinks = 16;
+static std::atomic<EffectiveSink*> crash_sinks[kMaxCrashSinks];
+
+EffectiveSink::EffectiveSink(const Config& conf) : conf_(std::move(conf)), sink_id_(next_sink_id++) {
+    LOG_INFO("EffectiveSink: dir={}, prefix={}, pub_key={}, interval={}, single_size={}, total_size={}, ring_size={}, "
+             "block_size={}, dict_path={}, compress_workers={}, cipher_mode={}, crypt_scope={}, cache_segments={}, "
+             "segment_size={}, full_policy={}, cache_dir={}, cache_populate={}, cache_huge_pages={}, seal_ratio={}, "
+             "target_flush_interval={}, min_segment_size={}, max_segment_size={}, io_depth={}, io_backend={}, "
+             "durability={}, sync_interval={}, shutdown_timeout={}, crash_hook={}",
              conf_.dir.string(),
              conf_.prefix,
              conf_.pub_key,
              conf_.interval.count(),
              conf_.single_size.count(),
-             conf_.total_size.count());
+             conf_.total_size.count(),
+             conf_.ring_size.count(),
+             conf_.block_size.count(),
+             conf_.dict_path.string(),
+             conf_.compress_workers,
+             static_cast<uint32_t>(conf_.cipher_mode),
+             static_cast<int>(conf_.crypt_scope),
+             conf_.cache_segments,
+             conf_.segment_size.count(),
+             static_cast<int>(conf_.full_policy),
+             conf_.cache_dir.string(),
+             conf_.cache_populate,
+             conf_.cache_huge_pages,
+             conf_.seal_ratio,
+             conf_.target_flush_interval.count(),
+             conf_.min_segment_size.count(),
+             conf_.max_segment_size.count(),
+             conf_.io_depth,
+             static_cast<int>(conf_.io_backend),
+             static_cast<int>(conf_.durability),
+             conf_.sync_interval.count(),
+             conf_.shutdown_timeout.count(),
+             conf_.crash_hook);
     if (!std::filesystem::exists(conf_.dir)) {
         std::filesystem::create_directories(conf_.dir);
     }
+    if (!std::filesystem::exists(CacheDir())) {
+        std::filesystem::create_directories(CacheDir());
+    }
 
     // auto ecdh_key = crypt::GenerateECDHkeyPair();
     const auto& [client_pri, client_pub] = crypt::GenerateECDHkeyPair();
@@ -31,36 +143,96 @@ EffectiveSink::EffectiveSink(const Config& conf) : conf_(std::move(conf)) {
     std::string svr_pub_key_bin = crypt::HexKeyToBinary(conf_.pub_key);
     std::string shared_secret = crypt::ComputeECDHSharedSecret(client_pri, svr_pub_key_bin);
 
-    crypt_ = std::make_unique<crypt::AESCrypt>(shared_secret);
-    compress_ = std::make_unique<compress::ZstdCompress>();
+    if (conf_.cipher_mode == crypt::CipherMode::kAesCtr) {
+        crypt_ = std::make_unique<crypt::AESCtrCrypt>(shared_secret);
+    } else {
+        crypt_ = std::make_unique<crypt::AESCrypt>(shared_secret);
+    }
+
+    chunk_crypt_ = std::make_unique<crypt::AESCtrCrypt>(shared_secret);
+    if (conf_.crypt_scope == CryptScope::kChunk && conf_.cipher_mode != crypt::CipherMode::kAesCtr) {
+        LOG_ERROR("EffectiveSink: chunk crypt scope requires CTR mode, fallback to item scope");
+        conf_.crypt_scope = CryptScope::kItem;
+    }
+    compress_ = CreateCompression();
+
+    if (UseStaging() && conf_.compress_workers > 0) {
+        compressors_ = std::make_unique<detail::CompressorPool>();
+        for (uint32_t i = 0; i < conf_.compress_workers; ++i) {
+            compressors_->Add(CreateCompression());
+        }
+        compress_pool_ = std::make_unique<ThreadPool>(conf_.compress_workers);
+        compress_pool_->Start();
+    }
 
     formatter_ptr_ = std::make_unique<EffectiveFormatter>();
 
     task_runner_ = CREATE_NEW_TASK_RUNNER;
+    flush_runner_ = CREATE_NEW_TASK_RUNNER;
 
-    master_cache_ = std::make_unique<MMapHandle>(conf_.dir / "master_cache");
-    slave_cache_ = std::make_unique<MMapHandle>(conf_.dir / "slave_cache");
+    if (conf_.cache_segments < 2) {
+        LOG_ERROR("EffectiveSink: cache_segments={} is too small, use 2", conf_.cache_segments);
+        conf_.cache_segments = 2;
+    }
+    if (conf_.seal_ratio <= 0 || conf_.seal_ratio > 1) {
+        LOG_ERROR("EffectiveSink: seal_ratio={} is invalid, use 0.8", conf_.seal_ratio);
+        conf_.seal_ratio = 0.8;
+    }
+    seal_bytes_ = space_cast<bytes>(conf_.segment_size).count() * conf_.seal_ratio;
+    if (conf_.io_depth > 0) {
+        writer_ = FileWriter::Create(conf_.io_backend, conf_.io_depth);
+    }
+    RecoverCaches();
 
-    if (!master_cache_ || !slave_cache_) {
-        throw std::runtime_error("EffectiveSink::EffectiveSink: create mmap failed");
+    repeated_tasks_.push_back(POST_REPEATED_TASK(flush_runner_, [this]() { RemoveOldFile(); }, conf_.interval, -1));
+
+    if (Adaptive()) {
+        repeated_tasks_.push_back(
+                POST_REPEATED_TASK(flush_runner_, [this]() { SealByInterval(); }, conf_.target_flush_interval, -1));
     }
 
-    if (!slave_cache_->Empty()) {
-        slave_is_free_.store(false);
-        PrepareCacheToFile();
-        WAIT_TASK_IDLE(task_runner_);  // 有可能主从都是有数据的，后续还需要处理主cache
+    if (conf_.durability != Durability::kNone) {
+        repeated_tasks_.push_back(
+                POST_REPEATED_TASK(flush_runner_, [this]() { SyncByInterval(); }, conf_.sync_interval, -1));
+    }
+
+    if (UseStaging()) {
+        repeated_tasks_.push_back(
+                POST_REPEATED_TASK(task_runner_, [this]() { DrainStaging(); }, kStagingDrainInterval, -1));
     }
 
-    if (!master_cache_->Empty()) {
-        if (slave_cache_->Empty()) {
-            slave_is_free_.store(false);
-            SwapCache();
+    if (conf_.crash_hook) {
+        Crc32c(nullptr, 0);  // 信号处理函数中计算校验和，提前完成实现的选择
+        auto slot = std::find_if(std::begin(crash_sinks), std::end(crash_sinks), [this](auto& sink) {
+            EffectiveSink* expected = nullptr;
+            return sink.compare_exchange_strong(expected, this);
+        });
+        if (slot == std::end(crash_sinks)) {
+            LOG_ERROR("EffectiveSink: too many sinks with crash hook, max {}", kMaxCrashSinks);
+        } else {
+            InstallCrashHandler(&EffectiveSink::OnCrashSignal);
         }
-        PrepareCacheToFile();
-        // WAIT_TASK_IDLE(task_runner_);
     }
+}
+
+EffectiveSink::~EffectiveSink() {
+    Shutdown(conf_.shutdown_timeout);
+
+    // 等待 Shutdown 之后提交的任务执行完，之后不会再有任务访问sink
+    WAIT_TASK_IDLE(task_runner_);
+    WAIT_TASK_IDLE(flush_runner_);
+
+    // 线程局部的生产者可能比sink活得更久，标记关闭后由生产者线程自行回收
+    std::lock_guard<std::mutex> lock(producers_mutex_);
+    for (auto& producer : producers_) {
+        producer->closed.store(true);
+    }
+    writer_.reset();  // 等待在途的写入完成，完成回调会访问段环
 
-    POST_REPEATED_TASK(task_runner_, [this]() { RemoveOldFile(); }, conf_.interval, -1);
+    for (auto& sink : crash_sinks) {
+        EffectiveSink* expected = this;
+        sink.compare_exchange_strong(expected, nullptr);
+    }
 }
 
 // 日志方法
@@ -69,108 +241,1061 @@ void EffectiveSink::Log(const LogMsg& msg) {
 
     formatter_ptr_->Format(msg, &buf);
 
-    // 压缩 + 加密
-    if (master_cache_->Empty()) {
-        compress_->ResetStream();
+    if (UseStaging()) {
+        StageLog(msg, buf);
+    } else {
+        LogDirect(msg, buf);
     }
-    {
-        std::lock_guard<std::mutex> lock(mutex_);
-        // 压缩器输出最坏情况所需空间大小
-        compress_buf_.reserve(compress_->CompressBound(buf.size()));
-        size_t real_compress_buf_size =
-                compress_->Compress(buf.data(), buf.size(), compress_buf_.data(), compress_buf_.capacity());
-        if (!real_compress_buf_size) {
-            LOG_ERROR("EffectiveSink::Log: compress failed");
-        }
-
-        encrypted_buf_.clear();
-        size_t kAuthenticationTag = 16;
-        encrypted_buf_.reserve(real_compress_buf_size + kAuthenticationTag);
-        crypt_->Encrypt(compress_buf_.data(), real_compress_buf_size, encrypted_buf_);
-        if (encrypted_buf_.empty()) {
-            LOG_ERROR("EffectiveSink::Log: encrypt failed");
-            return;
+
+    // 只有 error 日志付出等待落盘的开销；暂存环模式下日志还没进入缓存，排空后再同步
+    if (conf_.durability == Durability::kErrorSync && msg.Level() >= LogLevel::kError) {
+        if (UseStaging()) {
+            error_sync_pending_.store(true);
+            ScheduleDrain();
+        } else {
+            SyncCaches(true);
         }
-        WriteToCache(encrypted_buf_.data(), encrypted_buf_.size());
     }
+}
 
-    if (NeedSwapCache()) {
-        if (slave_cache_->Empty()) {
-            slave_is_free_.store(false);
-            SwapCache();
-        }
-        PrepareCacheToFile();
+// 调用线程上直接压缩加密写入缓存，每条日志都立即进入mmap
+void EffectiveSink::LogDirect(const LogMsg& msg, const MemoryBuffer& buf) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!EnsureCacheSpace() || !BeginChunkIfNeeded()) {
+        dropped_records_.fetch_add(1, std::memory_order_relaxed);
+        return;
     }
-    // master 不为空 slave也不为空， master超过capacity会触发扩容
+    if (msg.site->Id() != 0) {
+        WriteSite(msg);
+    }
+    WriteItem(buf.data(), buf.size());
+    SealCacheIfNeeded();
 }
 
 void EffectiveSink::SetFormatter(std::unique_ptr<Formatter> formatter) {}
 
 void EffectiveSink::Flush() {
     TIMER_COUNT("Flush");
-    PrepareCacheToFile();
-    WAIT_TASK_IDLE(task_runner_);
+    if (UseStaging()) {
+        POST_TASK(task_runner_, [this]() { DrainStaging(); });
+        WAIT_TASK_IDLE(task_runner_);
+    }
+
+    // 没有空闲段时当前段封存不了，先等排队的段落盘完再封存
+    bool sealed = false;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        sealed = SealCache();
+    }
+    WaitFlushIdle();
 
-    if (slave_is_free_.load()) {
-        slave_is_free_.store(false);
-        SwapCache();
+    if (!sealed) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            SealCache();
+        }
+        WaitFlushIdle();
     }
-    PrepareCacheToFile();
+}
+
+bool EffectiveSink::Shutdown(std::chrono::milliseconds timeout) {
+    TIMER_COUNT("Shutdown");
+    auto deadline = std::chrono::steady_clock::now() + timeout;
+    // 先停掉定时任务，之后只有这里提交的排空和落盘
+    for (ctx::RepeatedTaskID task_id : repeated_tasks_) {
+        CANCEL_REPEATED_TASK(task_id);
+    }
+
+    bool in_time = true;
+    if (UseStaging()) {
+        auto drained = EXECUTOR->PostTaskAndGetResult(task_runner_, [this]() { DrainStaging(); });
+        in_time = drained.wait_until(deadline) == std::future_status::ready;
+    }
+
+    // 没有空闲段时等排队的段落盘腾出空间再封存
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (in_time && !SealCache()) {
+            in_time = segment_freed_.wait_until(lock, deadline) == std::cv_status::no_timeout;
+        }
+    }
+
+    // 落盘线程串行执行，排在封存之后的空任务完成时之前封存的段都已提交写入
+    if (in_time) {
+        auto flushed = EXECUTOR->PostTaskAndGetResult(flush_runner_, []() {});
+        in_time = flushed.wait_until(deadline) == std::future_status::ready;
+    }
+    if (in_time && writer_) {
+        in_time = writer_->WaitUntil(deadline);
+    }
+
+    if (!in_time) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            flush_abandoned_.store(true);
+        }
+        segment_freed_.notify_all();
+    }
+    // 超时后排队的落盘任务直接返回，只需要等正在执行的排空和已经在途的写入
     WAIT_TASK_IDLE(task_runner_);
+    WaitFlushIdle();
+
+    size_t pending = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        pending = sealed_.size() + (ActiveCache()->Empty() ? 0 : 1);
+    }
+    if (pending > 0) {
+        LOG_ERROR("EffectiveSink: shutdown timed out after {}ms, {} segments left in cache for recovery, dropped {}",
+                  timeout.count(),
+                  pending,
+                  DroppedRecords());
+        return false;
+    }
+    LOG_INFO("EffectiveSink: shutdown flushed all caches, dropped {}", DroppedRecords());
+    return true;
+}
+
+// 暂存到当前线程的环中，由task_runner_上的消费者批量写入缓存
+void EffectiveSink::StageLog(const LogMsg& msg, const MemoryBuffer& buf) {
+    detail::StagingProducer* producer = GetProducer();
+    uint32_t site_id = msg.site->Id();
+    bool deferred = !msg.args.empty();
+
+    if (!producer->ring.Fits(sizeof(detail::StageHeader) + buf.size())) {
+        // 超大日志放不进环，等本线程之前的日志全部写入缓存后直接写，保证线程内有序
+        while (!producer->ring.Empty()) {
+            ScheduleDrain();
+            std::this_thread::yield();
+        }
+        LogDirect(msg, buf);
+        return;
+    }
+
+    if (site_id != 0 && producer->NeedPublishSite(site_id, deferred)) {
+        static thread_local MemoryBuffer site_buf;
+        EffectiveFormatter::FormatSite(msg, &site_buf);
+        Stage(producer, {site_id, deferred ? detail::StageHeader::kSiteWithFmt : detail::StageHeader::kSite}, site_buf);
+        producer->published_sites[site_id] = deferred ? 2 : 1;
+    }
+    Stage(producer, {site_id, deferred ? detail::StageHeader::kDeferredRecord : detail::StageHeader::kRecord}, buf);
+}
+
+void EffectiveSink::Stage(detail::StagingProducer* producer,
+                          const detail::StageHeader& header,
+                          const MemoryBuffer& buf) {
+    uint32_t size = sizeof(header) + buf.size();
+    void* dest = producer->ring.Reserve(size);
+    while (!dest) {  // 环满了，唤醒消费者并让出CPU
+        ScheduleDrain();
+        std::this_thread::yield();
+        dest = producer->ring.Reserve(size);
+    }
+    memcpy(dest, &header, sizeof(header));
+    memcpy(static_cast<char*>(dest) + sizeof(header), buf.data(), buf.size());
+    // 只在越过高水位时唤醒消费者，平时由 kStagingDrainInterval 的定时排空处理，不在每条日志上碰共享的缓存行
+    if (producer->ring.Commit()) {
+        ScheduleDrain();
+    }
+}
+
+detail::StagingProducer* EffectiveSink::GetProducer() {
+    // sink_id_ 作为key，避免sink析构后地址被复用
+    static thread_local std::vector<std::pair<uint64_t, std::shared_ptr<detail::StagingProducer>>> producers;
+    for (auto iter = producers.begin(); iter != producers.end();) {
+        if (iter->first == sink_id_) {
+            return iter->second.get();
+        }
+        if (iter->second->closed.load(std::memory_order_relaxed)) {
+            iter = producers.erase(iter);
+        } else {
+            ++iter;
+        }
+    }
+
+    auto producer = std::make_shared<detail::StagingProducer>(space_cast<bytes>(conf_.ring_size).count());
+    {
+        std::lock_guard<std::mutex> lock(producers_mutex_);
+        producers_.push_back(producer);
+    }
+    producers.emplace_back(sink_id_, producer);
+    return producer.get();
+}
+
+// 同一时刻最多只有一个排空任务在排队；生产者只在环越过高水位或写满时调用
+void EffectiveSink::ScheduleDrain() {
+    if (drain_pending_.load(std::memory_order_relaxed) || drain_pending_.exchange(true)) {
+        return;
+    }
+    POST_TASK(task_runner_, [this]() { DrainStaging(); });
+}
+
+// 消费者：在task_runner_上排空所有线程的暂存环，压缩加密都在这里按批完成，调用线程只做一次拷贝
+void EffectiveSink::DrainStaging() {
+    drain_pending_.store(false);
+    {
+        std::lock_guard<std::mutex> lock(producers_mutex_);
+        // 线程已退出且数据已排空的环可以回收
+        producers_.erase(std::remove_if(producers_.begin(),
+                                        producers_.end(),
+                                        [](const std::shared_ptr<detail::StagingProducer>& producer) {
+                                            return producer.use_count() == 1 && producer->ring.Empty();
+                                        }),
+                         producers_.end());
+        drain_list_ = producers_;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 缓存段只在块边界上切换 (参见 WriteStaged)，新段总是从新的chunk开始
+        for (auto& producer : drain_list_) {
+            producer->ring.Consume([this](const uint8_t* data, uint32_t size) { WriteStaged(data, size); });
+        }
+        // 压缩块不跨越排空任务，排空结束时数据都已进入mmap
+        FlushBlock();
+        WriteCompressedBlocks(true);
+        SealCacheIfNeeded();
+    }
+    drain_list_.clear();
+
+    if (error_sync_pending_.load(std::memory_order_relaxed) && error_sync_pending_.exchange(false)) {
+        SyncCaches(true);
+    }
+}
+
+// 没有空间写入的日志记录按 full_policy 丢弃，调用点目录项总是收集
+void EffectiveSink::WriteStaged(const uint8_t* data, uint32_t size) {
+    detail::StageHeader header;
+    memcpy(&header, data, sizeof(header));
+    data += sizeof(header);
+    size -= sizeof(header);
+
+    switch (header.kind) {
+    case detail::StageHeader::kSite:
+    case detail::StageHeader::kSiteWithFmt: {
+        if (header.site_id >= site_defs_.size()) {
+            site_defs_.resize(header.site_id + 1);
+        }
+        // 不同线程提交的目录项内容相同，只是不一定带格式串，带格式串的不能被覆盖
+        SiteDef& def = site_defs_[header.site_id];
+        bool with_fmt = header.kind == detail::StageHeader::kSiteWithFmt;
+        if (with_fmt || !def.with_fmt) {
+            def.data.assign(reinterpret_cast<const char*>(data), size);
+            def.with_fmt = with_fmt;
+        }
+        break;
+    }
+    case detail::StageHeader::kRecord:
+    case detail::StageHeader::kDeferredRecord: {
+        // 每个块开始前检查容量，一次排空的数据再多也不会让当前段越过封存阈值
+        if (block_buf_.empty()) {
+            if (!EnsureBlockSpace() || !BeginChunkIfNeeded()) {
+                dropped_records_.fetch_add(1, std::memory_order_relaxed);
+                break;
+            }
+        }
+        uint32_t site_id = header.site_id;
+        bool need_fmt = header.kind == detail::StageHeader::kDeferredRecord;
+        if (site_id != 0 && site_id < site_defs_.size() && NeedWriteSite(site_id, need_fmt)) {
+            const SiteDef& def = site_defs_[site_id];
+            AppendBlock(def.data.data(), def.data.size());
+            MarkSiteWritten(site_id, def.with_fmt);
+        }
+        AppendBlock(data, size);
+        break;
+    }
+    default:
+        LOG_ERROR("EffectiveSink::WriteStaged: unknown kind {}", header.kind);
+        break;
+    }
+}
+
+void EffectiveSink::AppendBlock(const void* data, uint32_t size) {
+    if (chunk_broken_) {  // 记录可能引用丢失的调用点目录项，等下一个块开始时封存
+        return;
+    }
+    block_buf_.append(reinterpret_cast<const char*>(&size), sizeof(size));
+    block_buf_.append(static_cast<const char*>(data), size);
+    if (block_buf_.size() >= space_cast<bytes>(conf_.block_size).count()) {
+        FlushBlock();
+    }
+}
+
+// 整块压缩成一个独立的帧再加密，省去逐条flush的块头开销，块之间互不依赖
+void EffectiveSink::FlushBlock() {
+    if (block_buf_.empty()) {
+        return;
+    }
+
+    if (compress_pool_) {
+        // 块之间互不依赖，交给压缩线程并行压缩，这里只收集已经按序完成的块
+        auto block = std::make_shared<std::string>(std::move(block_buf_));
+        block_buf_.clear();
+        compressing_blocks_.push_back(
+                compress_pool_->SubmitWithFuture([this, block]() { return CompressBlockTask(*block); }));
+        WriteCompressedBlocks(false);
+        return;
+    }
+
+    if (ZeroCopy()) {
+        CompressToCache(block_buf_.data(), block_buf_.size(), detail::ItemHeader::kBlockMagic);
+        block_buf_.clear();
+        return;
+    }
+
+    compress_buf_.reserve(compress_->CompressBound(block_buf_.size()));
+    size_t real_compress_buf_size =
+            compress_->CompressBlock(block_buf_.data(), block_buf_.size(), compress_buf_.data(), compress_buf_.capacity());
+    block_buf_.clear();
+    if (!real_compress_buf_size) {
+        LOG_ERROR("EffectiveSink::FlushBlock: compress failed");
+        BreakChunk();
+        return;
+    }
+
+    EncryptToCache(compress_buf_.data(), real_compress_buf_size, detail::ItemHeader::kBlockMagic);
+}
+
+std::string EffectiveSink::CompressBlockTask(const std::string& block) {
+    auto compressor = compressors_->Acquire();
+    if (!compressor) {
+        return "";
+    }
+
+    std::string compressed;
+    compressed.resize(compressor->CompressBound(block.size()));
+    size_t real_compress_size = compressor->CompressBlock(block.data(), block.size(), compressed.data(), compressed.size());
+    compressed.resize(real_compress_size);
+    compressors_->Release(std::move(compressor));
+    return compressed;
+}
+
+// 排序器：压缩完成的顺序不固定，只从队首取，保证块在缓存中的顺序与提交顺序一致
+void EffectiveSink::WriteCompressedBlocks(bool wait) {
+    while (!compressing_blocks_.empty()) {
+        auto& front = compressing_blocks_.front();
+        if (!wait && front.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            break;
+        }
+
+        std::string compressed = front.get();
+        compressing_blocks_.pop_front();
+        if (compressed.empty()) {
+            LOG_ERROR("EffectiveSink::WriteCompressedBlocks: compress failed");
+            BreakChunk();
+            continue;
+        }
+        EncryptToCache(compressed.data(), compressed.size(), detail::ItemHeader::kBlockMagic);
+    }
+}
+
+// 当前段为空意味着开始一个新的chunk，压缩流和调用点目录都从头开始，保证每个chunk可以独立解码
+// 并行压缩时还有块在压缩中，说明chunk已经开始，只是还没写入缓存
+bool EffectiveSink::BeginChunkIfNeeded() {
+    if (chunk_broken_ && !SealBrokenChunk()) {
+        return false;
+    }
+    if (!ActiveCache()->Empty() || !compressing_blocks_.empty()) {
+        return true;
+    }
+    compress_->ResetStream();
+    ++chunk_epoch_;
+    chunk_start_ = std::chrono::steady_clock::now();
+
+    // 每个chunk一个新的nonce，和其他chunk参数一起存入缓存元数据
+    detail::ChunkMeta meta{};
+    meta.dict_id = dict_id_;
+    meta.cipher_mode = static_cast<uint32_t>(conf_.cipher_mode);
+    meta.flags = detail::ChunkHeader::kItemChecksum;
+    if (conf_.crypt_scope == CryptScope::kChunk) {
+        meta.flags |= detail::ChunkHeader::kChunkEncrypted;
+    }
+    meta.seq = ++segment_seq_;
+    memcpy(meta.pub_key, client_pub_key_.data(), std::min(client_pub_key_.size(), sizeof(meta.pub_key)));
+    if (conf_.cipher_mode == crypt::CipherMode::kAesCtr) {
+        std::string nonce = crypt::AESCtrCrypt::GenerateNonce();
+        memcpy(meta.nonce, nonce.data(), sizeof(meta.nonce));
+        crypt_->SetNonce(nonce);
+    }
+    memcpy(ActiveCache()->Meta(), &meta, sizeof(meta));
+    return true;
+}
+
+// 丢失的item已经推进了压缩流，或者带走了调用点目录项，同一chunk里后续的item都解码不了
+// 当前chunk已写入的item仍然完整，停止追加并在下一个chunk开始前封存，新chunk从压缩流的帧头开始
+void EffectiveSink::BreakChunk() {
+    compress_->ResetStream();
+    chunk_broken_ = true;
+}
+
+bool EffectiveSink::SealBrokenChunk() {
+    WriteCompressedBlocks(true);  // 压缩中的块属于损坏的chunk，封存前写入当前段
+    while (!SealCache()) {
+        if (conf_.full_policy != FullPolicy::kBlock || flush_abandoned_.load()) {
+            return false;
+        }
+        segment_freed_.wait(mutex_);
+    }
+    chunk_broken_ = false;
+    return true;
+}
+
+// 流式压缩 + 加密 后写入缓存
+void EffectiveSink::WriteItem(const void* data, size_t size) {
+    if (chunk_broken_) {
+        return;
+    }
+    if (ZeroCopy()) {
+        CompressToCache(data, size, detail::ItemHeader::kMagic);
+        return;
+    }
+
+    // 压缩器输出最坏情况所需空间大小
+    compress_buf_.reserve(compress_->CompressBound(size));
+    size_t real_compress_buf_size = compress_->Compress(data, size, compress_buf_.data(), compress_buf_.capacity());
+    if (!real_compress_buf_size) {
+        LOG_ERROR("EffectiveSink::Log: compress failed");
+        BreakChunk();
+        return;
+    }
+
+    EncryptToCache(compress_buf_.data(), real_compress_buf_size, detail::ItemHeader::kMagic);
+}
+
+// 压缩器直接输出到缓存预留的空间，需要加密时在原地加密，数据从暂存缓冲区到mmap只经过压缩这一遍
+void EffectiveSink::CompressToCache(const void* data, size_t size, uint32_t magic) {
+    MMapHandle* cache = ActiveCache();
+    size_t bound = compress_->CompressBound(size);
+    uint8_t* dest = cache->Reserve(sizeof(detail::ItemHeader) + bound);
+    if (!dest) {
+        LOG_ERROR("EffectiveSink::CompressToCache: reserve {} failed", bound);
+        BreakChunk();
+        return;
+    }
+
+    uint8_t* payload = dest + sizeof(detail::ItemHeader);
+    size_t real_compress_size = magic == detail::ItemHeader::kBlockMagic
+                                        ? compress_->CompressBlock(data, size, payload, bound)
+                                        : compress_->Compress(data, size, payload, bound);
+    if (!real_compress_size) {
+        LOG_ERROR("EffectiveSink::CompressToCache: compress failed");
+        BreakChunk();
+        return;
+    }
+
+    if (conf_.crypt_scope == CryptScope::kItem) {
+        // 密钥流按密文在chunk内的偏移定位，与 EncryptToCache 一致
+        crypt_->Seek(cache->Size() + sizeof(detail::ItemHeader));
+        if (!crypt_->EncryptInPlace(payload, real_compress_size)) {
+            LOG_ERROR("EffectiveSink::CompressToCache: encrypt failed");
+            BreakChunk();
+            return;
+        }
+    }
+
+    detail::ItemHeader head;
+    head.magic = magic;
+    head.size = real_compress_size;
+    head.crc = Crc32c(payload, real_compress_size);
+    memcpy(dest, &head, sizeof(head));
+    cache->Advance(sizeof(head) + real_compress_size);
+}
+
+// 加密压缩后的数据再写入缓存
+void EffectiveSink::EncryptToCache(const void* data, size_t size, uint32_t magic) {
+    if (conf_.crypt_scope == CryptScope::kChunk) {  // 落盘时整chunk加密
+        if (!WriteToCache(data, size, magic)) {
+            BreakChunk();
+        }
+        return;
+    }
+
+    // 密钥流按密文在chunk内的偏移定位，解码端用同样的偏移解密
+    MMapHandle* cache = ActiveCache();
+    crypt_->Seek(cache->Size() + sizeof(detail::ItemHeader));
+    if (ZeroCopy()) {  // 流加密密文等长，明文拷进缓存后原地加密，省去加密缓冲区
+        uint8_t* dest = cache->Reserve(sizeof(detail::ItemHeader) + size);
+        if (!dest) {
+            LOG_ERROR("EffectiveSink::EncryptToCache: reserve {} failed", size);
+            BreakChunk();
+            return;
+        }
+        uint8_t* payload = dest + sizeof(detail::ItemHeader);
+        memcpy(payload, data, size);
+        if (!crypt_->EncryptInPlace(payload, size)) {
+            LOG_ERROR("EffectiveSink::EncryptToCache: encrypt failed");
+            BreakChunk();
+            return;
+        }
+        detail::ItemHeader head;
+        head.magic = magic;
+        head.size = size;
+        head.crc = Crc32c(payload, size);
+        memcpy(dest, &head, sizeof(head));
+        cache->Advance(sizeof(head) + size);
+        return;
+    }
+
+    encrypted_buf_.clear();
+    size_t kAuthenticationTag = 16;
+    encrypted_buf_.reserve(size + kAuthenticationTag);
+    crypt_->Encrypt(data, size, encrypted_buf_);
+    if (encrypted_buf_.empty()) {
+        LOG_ERROR("EffectiveSink::Log: encrypt failed");
+        BreakChunk();
+        return;
+    }
+    if (!WriteToCache(encrypted_buf_.data(), encrypted_buf_.size(), magic)) {
+        BreakChunk();
+    }
+}
+
+// 当前chunk内首次出现的调用点先写一条目录项
+// 延迟格式化的日志需要目录项带上格式串，若之前写入的目录项没有格式串则补写一条
+void EffectiveSink::WriteSite(const LogMsg& msg) {
+    uint32_t site_id = msg.site->Id();
+    bool need_fmt = !msg.args.empty();
+    if (!NeedWriteSite(site_id, need_fmt)) {
+        return;
+    }
+
+    EffectiveFormatter::FormatSite(msg, &site_buf_);
+    WriteItem(site_buf_.data(), site_buf_.size());
+    MarkSiteWritten(site_id, need_fmt);
+}
+
+bool EffectiveSink::NeedWriteSite(uint32_t site_id, bool need_fmt) {
+    if (site_id >= site_states_.size()) {
+        site_states_.resize(site_id + 1, 0);
+    }
+
+    uint64_t state = site_states_[site_id];
+    bool written = (state >> 1) == chunk_epoch_;
+    bool with_fmt = state & 1;
+    return !written || (need_fmt && !with_fmt);
+}
+
+void EffectiveSink::MarkSiteWritten(uint32_t site_id, bool with_fmt) {
+    site_states_[site_id] = (chunk_epoch_ << 1) | (with_fmt ? 1 : 0);
 }
 
 // 写入到缓存
-void EffectiveSink::WriteToCache(const void* data, uint32_t size) {
+bool EffectiveSink::WriteToCache(const void* data, uint32_t size, uint32_t magic) {
     // 流式存储 需要head界定边界
     detail::ItemHeader head;
+    head.magic = magic;
     head.size = size;
-    master_cache_->Push(&head, sizeof(head));
-    master_cache_->Push(data, size);
+    head.crc = Crc32c(data, size);
+
+    // 头和数据一次预留，拷贝完成后才提交，落盘线程只会看到完整的item
+    // 压缩流和CTR密钥流的位置都是有序状态，写者仍然持有 mutex_ 串行写入，提交不会等待
+    MMapHandle* cache = ActiveCache();
+    uint8_t* dest = cache->Claim(sizeof(head) + size);
+    if (dest) {
+        memcpy(dest, &head, sizeof(head));
+        memcpy(dest + sizeof(head), data, size);
+        cache->Commit(dest, sizeof(head) + size);
+        return true;
+    }
+
+    // 当前容量放不下，扩容期间不能有其他写者
+    MMapHandle::Span spans[] = {{&head, sizeof(head)}, {data, size}};
+    if (!cache->PushV(spans, 2)) {
+        LOG_ERROR("EffectiveSink::WriteToCache: push {} failed", size);
+        return false;
+    }
+    return true;
+}
+
+// seal_bytes_ 固定模式下为 segment_size × seal_ratio，自适应模式下按写入速度计算
+// 不能只看映射容量的比例：零拷贝写入按压缩上限预留空间，映射会先于数据扩容，比例可能一直达不到阈值
+bool EffectiveSink::NeedSealCache() {
+    MMapHandle* cache = ActiveCache();
+    return cache->Size() >= seal_bytes_ || cache->GetRatio() > conf_.seal_ratio;
+}
+
+bool EffectiveSink::EnsureCacheSpace() {
+    if (!NeedSealCache()) {
+        return true;
+    }
+
+    while (!SealCache()) {
+        switch (conf_.full_policy) {
+        case FullPolicy::kSpill:  // 当前段超出容量后由mmap扩容
+            return true;
+        case FullPolicy::kDrop:
+            return false;
+        case FullPolicy::kBlock:
+            if (flush_abandoned_.load()) {  // 关闭超时后不会再有段被回收，继续写当前段
+                return true;
+            }
+            segment_freed_.wait(mutex_);
+            break;
+        }
+    }
+    return true;
+}
+
+// 并行压缩时还在压缩中的块没有计入当前段的大小，超出阈值的部分最多是这些块
+bool EffectiveSink::EnsureBlockSpace() {
+    if (!NeedSealCache()) {
+        return true;
+    }
+    WriteCompressedBlocks(true);  // 封存前当前chunk的块都要进入当前段
+    return EnsureCacheSpace();
+}
+
+bool EffectiveSink::SealCache() {
+    if (ActiveCache()->Empty()) {
+        return true;
+    }
+    if (free_segments_.empty()) {
+        return false;
+    }
+
+    if (Adaptive()) {
+        UpdateSealTarget(ActiveCache()->Size(), std::chrono::steady_clock::now() - chunk_start_);
+    }
+    sealed_.push_back(active_);
+    active_ = free_segments_.front();
+    free_segments_.pop_front();
+    crash_segment_.store(ActiveCache(), std::memory_order_release);
+    PrepareCacheToFile();
+    return true;
 }
 
-// 判断主cache容量
-bool EffectiveSink::NeedSwapCache() {
-    return master_cache_->GetRatio() > 0.8;
+// 段大小 = 写入速度 × 封存间隔，落盘比目标间隔还慢时按落盘耗时算，避免段还没落盘下一个就写满了
+void EffectiveSink::UpdateSealTarget(size_t size, std::chrono::steady_clock::duration elapsed) {
+    constexpr double kSmoothing = 0.3;
+    double seconds = std::max(std::chrono::duration<double>(elapsed).count(), 0.001);
+    double rate = size / seconds;
+    ingest_rate_ = ingest_rate_ > 0 ? ingest_rate_ * (1 - kSmoothing) + rate * kSmoothing : rate;
+
+    double interval = std::chrono::duration<double>(conf_.target_flush_interval).count();
+    double target = ingest_rate_ * std::max(interval, flush_latency_);
+    double min_bytes = space_cast<bytes>(conf_.min_segment_size).count() * conf_.seal_ratio;
+    double max_bytes = space_cast<bytes>(conf_.max_segment_size).count() * conf_.seal_ratio;
+    seal_bytes_ = static_cast<size_t>(std::clamp(target, min_bytes, max_bytes));
 }
 
-// 交换主从cache
-void EffectiveSink::SwapCache() {
+void EffectiveSink::SealByInterval() {
     std::lock_guard<std::mutex> lock(mutex_);
-    std::swap(master_cache_, slave_cache_);
+    if (!ActiveCache()->Empty() && std::chrono::steady_clock::now() - chunk_start_ >= conf_.target_flush_interval) {
+        SealCache();
+    }
+}
+
+// 写入后尽早封存写满的段，让落盘和后续写入并行；没有空闲段时留给下次写入前按策略处理
+void EffectiveSink::SealCacheIfNeeded() {
+    if (NeedSealCache()) {
+        SealCache();
+    }
+}
+
+static detail::ChunkMeta ReadChunkMeta(const MMapHandle& cache) {
+    detail::ChunkMeta meta;
+    memcpy(&meta, cache.Meta(), sizeof(meta));
+    return meta;
 }
 
-// slave缓存手动落盘
+// 逐个校验item，返回第一个不完整 (崩溃时写了一半) 的item之前的数据大小
+// 没有校验和的旧缓存只能检查item头和长度
+static size_t ValidCacheSize(const MMapHandle& cache) {
+    bool checksum = ReadChunkMeta(cache).flags & detail::ChunkHeader::kItemChecksum;
+    size_t header_size = checksum ? sizeof(detail::ItemHeader) : detail::ItemHeader::kSizeV1;
+    const uint8_t* data = cache.Data();
+    size_t size = cache.Size();
+    size_t offset = 0;
+    while (offset + header_size <= size) {
+        detail::ItemHeader head;
+        memcpy(&head, data + offset, header_size);
+        if (head.magic != detail::ItemHeader::kMagic && head.magic != detail::ItemHeader::kBlockMagic &&
+            head.magic != detail::ItemHeader::kCrashMagic) {
+            break;
+        }
+        if (head.size > size - offset - header_size) {
+            break;
+        }
+        if (checksum && Crc32c(data + offset + header_size, head.size) != head.crc) {
+            break;
+        }
+        offset += header_size + head.size;
+    }
+    return offset;
+}
+
+// 最早封存的段出队落盘，段在落盘完成回收之前不在任何队列中，写入方不会复用它
+// 异步写入时提交后立即返回，下一个段可以在这个段写完之前开始落盘
 void EffectiveSink::CacheToFile() {
     TIMER_COUNT("CacheToFile");
-    if (slave_is_free_.load()) {
-        return;
+    size_t index = 0;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        // 关闭超时后封存的段留在缓存文件中，下次启动时恢复
+        if (sealed_.empty() || flush_abandoned_.load()) {
+            return;
+        }
+        index = sealed_.front();
+        sealed_.pop_front();
+    }
+
+    // 封存前预留的item可能还在拷贝
+    while (!segments_[index]->Committed()) {
+        std::this_thread::yield();
     }
 
-    if (slave_cache_->Empty()) {
-        slave_is_free_.store(true);
+    auto start = std::chrono::steady_clock::now();
+    if (writer_) {
+        WriteChunkAsync(*segments_[index], [this, index, start]() {
+            RecycleSegment(index, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        });
         return;
     }
 
-    // 落盘 这里不需要加锁了，只要slave不为空 不会发生主从cache的交换，异步调用CacheToFile 会先将slave_is_free_
-    // 置为false 文件头需要存放公钥 以便解析段解析
-    auto file_path = GetLogFilePath();
+    // 系统调用 主要开销在这里，所以放到落盘线程上执行，不需要持有锁
+    WriteChunk(*segments_[index]);
+    RecycleSegment(index, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+}
+
+void EffectiveSink::RecycleSegment(size_t index, double latency) {
+    size_t capacity = 0;
+    {
+        std::lock_guard<std::mutex> sync_lock(sync_mutex_);
+        std::lock_guard<std::mutex> lock(mutex_);
+        segments_[index]->Clear();
+        if (Adaptive()) {
+            flush_latency_ = flush_latency_ > 0 ? flush_latency_ * 0.7 + latency * 0.3 : latency;
+            capacity = seal_bytes_ / conf_.seal_ratio;
+        }
+    }
+
+    // 段在放回空闲队列之前只属于落盘方，按目标大小扩容或者归还多余的映射，写入路径上不再扩容
+    MMapHandle* cache = segments_[index].get();
+    if (capacity && (cache->Capacity() < capacity || cache->Capacity() > capacity * 2)) {
+        cache->Reallocate(capacity);
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        free_segments_.push_back(index);
+    }
+    segment_freed_.notify_all();
+}
+
+// 段的大小在 mutex_ 下读取，同步时只用文件描述符，不阻塞写入
+// 已出队正在写入日志文件的段不再同步，它的数据由日志文件的同步负责
+void EffectiveSink::SyncCaches(bool wait) {
+    TIMER_COUNT("SyncCaches");
+    std::lock_guard<std::mutex> sync_lock(sync_mutex_);
+    std::vector<std::pair<size_t, size_t>> dirty;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (size_t index : sealed_) {
+            dirty.emplace_back(index, segments_[index]->Size());
+        }
+        dirty.emplace_back(active_, segments_[active_]->Size());
+    }
+    for (auto& [index, size] : dirty) {
+        segments_[index]->Sync(size, wait);
+    }
+}
+
+void EffectiveSink::SyncByInterval() {
+    bool wait = conf_.durability == Durability::kSync;
+    SyncCaches(wait);
+    if (wait && log_file_ && log_dirty_.exchange(false) && !DataSync(log_file_->fd)) {
+        LOG_ERROR("EffectiveSink::SyncByInterval: fdatasync {} failed: {}", log_file_->path.string(), errno);
+    }
+}
+
+void EffectiveSink::WaitFlushIdle() {
+    WAIT_TASK_IDLE(flush_runner_);
+    if (writer_) {
+        writer_->Wait();
+    }
+}
+
+// 文件头需要存放公钥 以便解析段解析
+detail::ChunkHeader EffectiveSink::MakeChunkHeader(const MMapHandle& cache) {
     detail::ChunkHeader chunk_head;
-    chunk_head.size = slave_cache_->Size();
-    memcpy(chunk_head.pub_key, client_pub_key_.data(), client_pub_key_.size());
+    detail::ChunkMeta meta = ReadChunkMeta(cache);
+    chunk_head.size = cache.Size();
+    chunk_head.dict_id = meta.dict_id;
+    chunk_head.cipher_mode = meta.cipher_mode;
+    memcpy(chunk_head.nonce, meta.nonce, sizeof(chunk_head.nonce));
+    chunk_head.flags = meta.flags;
+    // 整chunk加密在落盘时用本次的密钥；逐条加密的数据用写入时的密钥，恢复的缓存要带上原来的公钥
+    bool has_key = std::any_of(std::begin(meta.pub_key), std::end(meta.pub_key), [](char c) { return c != 0; });
+    if (!(meta.flags & detail::ChunkHeader::kChunkEncrypted) && has_key) {
+        memcpy(chunk_head.pub_key, meta.pub_key, sizeof(chunk_head.pub_key));
+    } else {
+        memcpy(chunk_head.pub_key, client_pub_key_.data(), client_pub_key_.size());
+    }
+    return chunk_head;
+}
+
+bool EffectiveSink::WriteChunk(const MMapHandle& cache) {
+    auto file = GetLogFile();
+    if (!file) {
+        return false;
+    }
+
+    detail::ChunkHeader chunk_head = MakeChunkHeader(cache);
+    uint64_t offset = file->size;
+    bool ok = WriteFile(file->fd, &chunk_head, sizeof(chunk_head));
+    if (ok && (chunk_head.flags & detail::ChunkHeader::kChunkEncrypted)) {
+        ok = WriteEncryptedChunk(file->fd, cache);
+    } else if (ok) {
+        ok = CopyFileRange(cache.Fd(), MMapHandle::DataOffset(), file->fd, chunk_head.size);
+    }
+    log_dirty_.store(true);
+    if (!ok) {
+        LOG_ERROR("EffectiveSink::WriteChunk: write {} bytes to {} failed: {}",
+                  chunk_head.size,
+                  file->path.string(),
+                  errno);
+        return false;
+    }
+    file->size += sizeof(chunk_head) + chunk_head.size;
+    file->Written(offset, sizeof(chunk_head) + chunk_head.size);
+    return true;
+}
+
+// 整个chunk作为一段连续的CTR密钥流加密，分段处理避免复制整个chunk
+bool EffectiveSink::WriteEncryptedChunk(int fd, const MMapHandle& cache) {
+    detail::ChunkMeta meta = ReadChunkMeta(cache);
+    chunk_crypt_->SetNonce(std::string(reinterpret_cast<const char*>(meta.nonce), sizeof(meta.nonce)));
+    chunk_crypt_->Seek(0);
+
+    constexpr size_t kPieceSize = 64 * 1024;
+    size_t size = cache.Size();
+    std::string piece;
+    for (size_t offset = 0; offset < size; offset += kPieceSize) {
+        piece.clear();
+        chunk_crypt_->Encrypt(cache.Data() + offset, std::min(kPieceSize, size - offset), piece);
+        if (!WriteFile(fd, piece.data(), piece.size())) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void EffectiveSink::EncryptChunk(const MMapHandle& cache, std::string* out) {
+    detail::ChunkMeta meta = ReadChunkMeta(cache);
+    chunk_crypt_->SetNonce(std::string(reinterpret_cast<const char*>(meta.nonce), sizeof(meta.nonce)));
+    chunk_crypt_->Seek(0);
+    out->clear();
+    chunk_crypt_->Encrypt(cache.Data(), cache.Size(), *out);
+}
+
+// 写入位置在提交时分配，多个chunk同时写入文件的不同区间；
+// 明文直接从段的映射写出，整chunk加密的密文和chunk头放在请求自己的缓冲区里，写入完成后释放
+void EffectiveSink::WriteChunkAsync(const MMapHandle& cache, std::function<void()> done) {
+    auto file = GetLogFile();
+    if (!file) {
+        done();
+        return;
+    }
+
+    struct PendingChunk {
+        detail::ChunkHeader header;
+        std::string encrypted;
+        std::shared_ptr<detail::LogFile> file;
+    };
+    auto chunk = std::make_shared<PendingChunk>();
+    chunk->header = MakeChunkHeader(cache);
+    chunk->file = file;
+
+    std::vector<FileWriter::Span> spans{{&chunk->header, sizeof(chunk->header)}};
+    if (chunk->header.flags & detail::ChunkHeader::kChunkEncrypted) {
+        EncryptChunk(cache, &chunk->encrypted);
+        spans.push_back({chunk->encrypted.data(), chunk->encrypted.size()});
+    } else {
+        spans.push_back({cache.Data(), cache.Size()});
+    }
+
+    uint64_t offset = file->size;
+    file->size += sizeof(chunk->header) + cache.Size();
+    writer_->Write(file->fd, offset, std::move(spans), [this, chunk, offset, done = std::move(done)](bool ok) {
+        log_dirty_.store(true);
+        if (ok) {
+            chunk->file->Written(offset, sizeof(chunk->header) + chunk->header.size);
+        } else {
+            LOG_ERROR("EffectiveSink::WriteChunkAsync: write {} bytes to {} failed",
+                      chunk->header.size,
+                      chunk->file->path.string());
+        }
+        done();
+    });
+}
+
+// 不属于当前段环的缓存文件 (上次配置了更多的段、上次没恢复完的恢复文件) 和段环中有数据的段都交给落盘线程恢复；
+// 有数据的段改名为恢复文件，原位置换上新段，构造时不写日志文件，所有段都可以立即写入
+// 格式不认识的文件 (旧版本的主从缓存等) 不恢复，原样留在磁盘上：旧版本加密用的客户端密钥每次启动随机生成且没有保存，
+// 这些数据无法再解密
+void EffectiveSink::RecoverCaches() {
+    for (const char* name : {"master_cache", "slave_cache"}) {  // 旧版本的主从缓存总在日志目录下
+        if (std::filesystem::exists(conf_.dir / name)) {
+            LOG_ERROR("EffectiveSink: {} is from an older version and cannot be recovered, left in place",
+                      (conf_.dir / name).string());
+        }
+    }
+    std::vector<std::filesystem::path> leftovers;
+    for (auto& p : std::filesystem::directory_iterator(CacheDir())) {
+        std::string name = p.path().filename().string();
+        if ((name.rfind("cache_", 0) == 0 && std::strtoul(name.c_str() + 6, nullptr, 10) >= conf_.cache_segments) ||
+            name.rfind(kRecoveryPrefix, 0) == 0) {
+            if (!MMapHandle::Recognized(p.path())) {
+                LOG_ERROR("EffectiveSink: unrecognized cache {} left in place", p.path().string());
+                continue;
+            }
+            leftovers.push_back(p.path());
+        }
+    }
+
+    MMapHandle::Options options;
+    options.capacity = space_cast<bytes>(conf_.segment_size).count();
+    options.reserve = options.capacity * kSegmentReserveFactor;
+    options.populate = conf_.cache_populate;
+    options.huge_pages = conf_.cache_huge_pages;
+    uint32_t recovery_id = 0;
+    for (uint32_t i = 0; i < conf_.cache_segments; ++i) {
+        std::filesystem::path path = CacheDir() / ("cache_" + std::to_string(i));
+        if (!MMapHandle::Recognized(path)) {
+            std::filesystem::path aside = CacheDir() / (kUnrecognizedPrefix + path.filename().string());
+            std::error_code ec;
+            std::filesystem::rename(path, aside, ec);
+            if (ec) {
+                LOG_ERROR("EffectiveSink: rename {} to {} failed: {}", path.string(), aside.string(), ec.message());
+            } else {
+                LOG_ERROR("EffectiveSink: unrecognized cache {} moved to {}", path.string(), aside.string());
+            }
+        }
+        auto cache = std::make_unique<MMapHandle>(path, options);
+        if (!cache->Empty()) {
+            // 新段的序号接在遗留段之后，下次恢复时顺序仍然正确
+            segment_seq_ = std::max(segment_seq_, ReadChunkMeta(*cache).seq);
+            cache.reset();
+
+            std::filesystem::path recovery;
+            do {
+                recovery = CacheDir() / (kRecoveryPrefix + std::to_string(recovery_id++));
+            } while (std::filesystem::exists(recovery));
+            std::error_code ec;
+            std::filesystem::rename(path, recovery, ec);
+            if (ec) {
+                LOG_ERROR("EffectiveSink: rename {} to {} failed: {}", path.string(), recovery.string(), ec.message());
+            } else {
+                leftovers.push_back(recovery);
+            }
+            cache = std::make_unique<MMapHandle>(path, options);
+        }
+        segments_.push_back(std::move(cache));
+    }
+
+    // 改名失败的段仍有数据，按原来的方式排队落盘
+    std::vector<size_t> pending;
+    for (size_t i = 0; i < segments_.size(); ++i) {
+        if (segments_[i]->Empty()) {
+            free_segments_.push_back(i);
+        } else {
+            pending.push_back(i);
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (!leftovers.empty()) {
+        auto recover = [this, leftovers]() { RecoverLeftovers(leftovers); };
+        POST_TASK(flush_runner_, recover);
+    }
+    for (size_t index : pending) {
+        sealed_.push_back(index);
+        PrepareCacheToFile();
+    }
+    while (free_segments_.empty()) {  // 所有段都改名失败，等落盘后再选写入段
+        segment_freed_.wait(mutex_);
+    }
+    active_ = free_segments_.front();
+    free_segments_.pop_front();
+    crash_segment_.store(ActiveCache(), std::memory_order_release);
+}
+
+void EffectiveSink::RecoverLeftovers(const std::vector<std::filesystem::path>& files) {
+    TIMER_COUNT("RecoverLeftovers");
+    std::vector<std::pair<std::filesystem::path, std::unique_ptr<MMapHandle>>> caches;
+    for (auto& file : files) {
+        caches.emplace_back(file, std::make_unique<MMapHandle>(file));
+    }
+    std::sort(caches.begin(), caches.end(), [](const auto& lhs, const auto& rhs) {
+        return ReadChunkMeta(*lhs.second).seq < ReadChunkMeta(*rhs.second).seq;
+    });
+    if (!caches.empty()) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        segment_seq_ = std::max(segment_seq_, ReadChunkMeta(*caches.back().second).seq);
+    }
+
+    size_t recovered = 0;
+    for (auto& [file, cache] : caches) {
+        if (flush_abandoned_.load()) {  // 关闭超时，剩下的文件留给下次启动
+            break;
+        }
+        // 压缩流中后面的item依赖前面的，从第一个写坏的item处截断；崩溃时已封存的段同样校验，校验只读一遍数据
+        size_t valid = ValidCacheSize(*cache);
+        if (valid < cache->Size()) {
+            LOG_ERROR("EffectiveSink: truncate torn {}cache {} from {} to {} bytes",
+                      cache->Sealed() ? "sealed " : "",
+                      file.string(),
+                      cache->Size(),
+                      valid);
+            cache->Resize(valid);
+        }
+        if (!cache->Empty() && !WriteChunk(*cache)) {
+            continue;  // 写入失败保留文件，下次启动再恢复
+        }
+        cache.reset();
+        std::error_code ec;
+        std::filesystem::remove(file, ec);
+        ++recovered;
+    }
+    LOG_INFO("EffectiveSink: recovered {} of {} leftover caches", recovered, caches.size());
+}
+
+void EffectiveSink::OnCrashSignal(int signal) {
+    for (auto& sink : crash_sinks) {
+        EffectiveSink* target = sink.load(std::memory_order_acquire);
+        if (target) {
+            target->SealOnCrash(signal);
+        }
+    }
+}
 
-    // 系统调用 主要开销在这里，所以需要放到调度器里面异步执行
-    std::ofstream ofs(file_path, std::ios::binary | std::ios::app);
-    ofs.write(reinterpret_cast<char*>(&chunk_head), sizeof(chunk_head));
-    ofs.write(reinterpret_cast<char*>(slave_cache_->Data()), chunk_head.size);
-    ofs.close();
+// 只读写当前段的映射，不加锁；崩溃的线程可能正持有 mutex_ 写到一半，未提交的部分由 SealOnCrash 丢弃
+void EffectiveSink::SealOnCrash(int signal) {
+    MMapHandle* cache = crash_segment_.load(std::memory_order_acquire);
+    if (!cache) {
+        return;
+    }
+    detail::CrashRecord record{};
+    record.signal = signal;
+    record.pid = static_cast<int32_t>(GetProcessId());
+    record.tid = static_cast<int32_t>(GetThreadId());
+    record.timestamp =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::system_clock::now().time_since_epoch())
+                    .count();
 
-    slave_cache_->Clear();
-    slave_is_free_.store(true);
+    detail::ItemHeader head;
+    head.magic = detail::ItemHeader::kCrashMagic;
+    head.size = sizeof(record);
+    head.crc = Crc32c(&record, sizeof(record));
+    uint8_t tail[sizeof(head) + sizeof(record)];
+    memcpy(tail, &head, sizeof(head));
+    memcpy(tail + sizeof(head), &record, sizeof(record));
+    cache->SealOnCrash(tail, sizeof(tail));
 }
 
 // 异步落盘
 void EffectiveSink::PrepareCacheToFile() {
-    POST_TASK(task_runner_, [this]() { CacheToFile(); });
+    POST_TASK(flush_runner_, [this]() { CacheToFile(); });
 }
 
 // 淘汰旧日志 定时任务
@@ -198,6 +1323,26 @@ void EffectiveSink::RemoveOldFile() {
     }
 }
 
+// 字典加载失败时退回无字典压缩，日志照常写入
+std::unique_ptr<compress::Compression> EffectiveSink::CreateCompression() {
+    auto zstd = std::make_unique<compress::ZstdCompress>();
+    if (conf_.dict_path.empty()) {
+        return zstd;
+    }
+
+    if (dict_data_.empty()) {
+        std::ifstream ifs(conf_.dict_path, std::ios::binary);
+        dict_data_.assign(std::istreambuf_iterator<char>(ifs), std::istreambuf_iterator<char>());
+    }
+    if (dict_data_.empty() || !zstd->LoadDictionary(dict_data_.data(), dict_data_.size())) {
+        LOG_ERROR("EffectiveSink::CreateCompression: load dictionary failed, path={}", conf_.dict_path.string());
+        return std::make_unique<compress::ZstdCompress>();
+    }
+    dict_id_ = zstd->DictId();
+    LOG_INFO("EffectiveSink::CreateCompression: dict_id={}, size={}", dict_id_, dict_data_.size());
+    return zstd;
+}
+
 // 文件命名拼接
 std::filesystem::path EffectiveSink::GetLogFilePath() {
     auto GetDateTimePath = [this]() -> std::filesystem::path {
@@ -236,4 +1381,50 @@ std::filesystem::path EffectiveSink::GetLogFilePath() {
     LOG_INFO("EffectiveSink::GetFilePath: log_file_path={}", log_file_path_.string());
     return log_file_path_;
 }
+
+std::shared_ptr<detail::LogFile> EffectiveSink::GetLogFile() {
+    auto file_path = GetLogFilePath();
+    // 淘汰旧日志时可能删掉了当前文件，继续写入已删除的文件会丢日志
+    if (log_file_ && (file_path != log_file_->path || !std::filesystem::exists(file_path))) {
+        if (conf_.durability == Durability::kSync && log_dirty_.exchange(false)) {  // 分片前的写入也要落盘
+            DataSync(log_file_->fd);
+        }
+        log_file_.reset();
+    }
+
+    if (!log_file_) {
+        int fd = OpenAppendFile(file_path);
+        if (fd == -1) {
+            LOG_ERROR("EffectiveSink::GetLogFile: open {} failed: {}", file_path.string(), errno);
+            return nullptr;
+        }
+        log_file_ = std::make_shared<detail::LogFile>(fd, file_path, fs::GetFileSize(file_path));
+        // 一个分片写到 single_size 就切换，整个分片一次预留，避免追加写入产生碎片
+        size_t single_bytes = space_cast<bytes>(conf_.single_size).count();
+        if (log_file_->size < single_bytes && !PreallocateFile(fd, single_bytes)) {
+            LOG_ERROR("EffectiveSink::GetLogFile: preallocate {} failed: {}", file_path.string(), errno);
+        }
+    }
+    return log_file_;
+}
+
+namespace detail {
+LogFile::~LogFile() {
+    if (last_length) {
+        DropPageCache(fd, last_offset, last_length);
+    }
+    TrimPreallocated(fd);
+    CloseFile(fd);
+}
+
+void LogFile::Written(uint64_t offset, uint64_t length) {
+    StartWriteback(fd, offset, length);
+    std::lock_guard<std::mutex> lock(mutex);
+    if (last_length) {
+        DropPageCache(fd, last_offset, last_length);
+    }
+    last_offset = offset;
+    last_length = length;
+}
+}  // namespace detail
 }  // namespace logger
\ No newline at end of file
@@ -1,11 +1,16 @@
 #pragma once
 
+#include <cstddef>
 #include <filesystem>
 #include <string>
 #include <chrono>
 #include <memory>
 #include <filesystem>
+#include <condition_variable>
+#include <deque>
+#include <future>
 #include <mutex>
+#include <vector>
 
 #include "sink.h"
 #include "space.h"
@@ -15,29 +20,123 @@
 #include "zstd_compress.h"
 #include "crypt.h"
 #include "context.h"
+#include "spsc_ring.h"
+#include "thread_pool.h"
+#include "file_writer.h"
 
 namespace logger {
 namespace detail {
 struct ChunkHeader {
-    static constexpr uint64_t kMagic = 0xdeadbeefdada1100;
+    static constexpr uint64_t kMagic = 0xdeadbeefdada1103;
+    static constexpr uint64_t kMagicV1 = 0xdeadbeefdada1100;  // 只有 magic size pub_key
+    static constexpr size_t kSizeV1 = 144;
+    static constexpr uint64_t kMagicV2 = 0xdeadbeefdada1101;  // 增加 dict_id，cipher_mode 位置恒为0 (CBC)
+    static constexpr size_t kSizeV2 = 152;
+    static constexpr uint64_t kMagicV3 = 0xdeadbeefdada1102;  // 增加 cipher_mode nonce
+    static constexpr size_t kSizeV3 = 168;
+
+    static constexpr uint32_t kChunkEncrypted = 1;  // 整个chunk落盘时一次性加密，item不单独加密
+    static constexpr uint32_t kItemChecksum = 2;    // item头带 CRC32C，没有这一位时item头为 ItemHeader::kSizeV1
+
     uint64_t magic;
     uint64_t size;
     char pub_key[128];
+    uint32_t dict_id;      // 压缩字典ID，0 表示不使用字典
+    uint32_t cipher_mode;  // crypt::CipherMode
+    uint8_t nonce[16];     // CTR模式下该chunk的nonce
+    uint32_t flags;
+    uint32_t reserved;
 
-    ChunkHeader() : magic(kMagic), size(0) {}
+    ChunkHeader()
+            : magic(kMagic), size(0), pub_key{}, dict_id(0), cipher_mode(0), nonce{}, flags(0), reserved(0) {}
 };
+static_assert(offsetof(ChunkHeader, dict_id) == ChunkHeader::kSizeV1, "chunk header v1 layout changed");
+static_assert(offsetof(ChunkHeader, nonce) == ChunkHeader::kSizeV2, "chunk header v2 layout changed");
+static_assert(offsetof(ChunkHeader, flags) == ChunkHeader::kSizeV3, "chunk header v3 layout changed");
+
+// 随缓存一起持久化的chunk参数，落盘时填入ChunkHeader，重启后恢复的缓存仍按写入时的参数落盘
+struct ChunkMeta {
+    uint32_t dict_id;
+    uint32_t cipher_mode;
+    uint8_t nonce[16];
+    uint32_t flags;
+    uint64_t seq;       // 缓存段开始写入的顺序，重启恢复时按此顺序落盘
+    char pub_key[128];  // 写入时的客户端公钥，重启后密钥对重新生成，恢复的缓存仍按原公钥落盘；旧版本缓存中为空
+};
+static_assert(sizeof(ChunkMeta) <= MMapHandle::kMetaCapacity, "chunk meta is too large");
 
 struct ItemHeader {
     static constexpr uint32_t kMagic = 0xbe5fba11;
+    static constexpr uint32_t kBlockMagic = 0xbe5fba12;  // 压缩块，独立的压缩帧，解压后为若干条 [size:4][EffectiveMsg]
+    static constexpr uint32_t kCrashMagic = 0xbe5fba13;  // 崩溃记录，数据为不压缩不加密的 CrashRecord
+    static constexpr size_t kSizeV1 = 8;                 // 只有 magic size
     uint32_t magic;
     uint32_t size;
+    uint32_t crc;  // 数据 (缓存中存放的形式，逐条加密时为密文) 的 CRC32C，崩溃时写了一半的item校验不通过
+
+    ItemHeader() : magic(kMagic), size(0), crc(0) {}
+};
+static_assert(offsetof(ItemHeader, crc) == ItemHeader::kSizeV1, "item header v1 layout changed");
 
-    ItemHeader() : magic(kMagic), size(0) {}
+// 进程崩溃时信号处理函数追加到当前段末尾的记录，解码时还原成一条 critical 日志
+struct CrashRecord {
+    int32_t signal;
+    int32_t pid;
+    int32_t tid;
+    int32_t reserved;
+    int64_t timestamp;  // 毫秒
 };
+
+// 当前日志文件，异步写入时由在途的写入共同持有，分片切换后等写入全部完成才关闭
+// 打开时按分片大小预留磁盘块，关闭时归还没用上的部分；写入完成的chunk回写后从页缓存中丢弃
+struct LogFile {
+    LogFile(int fd, std::filesystem::path path, uint64_t size) : fd(fd), path(std::move(path)), size(size) {}
+    ~LogFile();
+
+    LogFile(const LogFile& other) = delete;
+    LogFile& operator=(const LogFile& other) = delete;
+
+    // 一个chunk写入完成，可以在任意线程上调用：发起这段的回写，丢弃上一个写完的chunk的页
+    // 上一个chunk的回写在它写完时已经发起，丢弃时通常不需要等待
+    void Written(uint64_t offset, uint64_t length);
+
+    int fd;
+    std::filesystem::path path;
+    uint64_t size;  // 下一个chunk的写入位置，只在落盘线程上修改
+
+    std::mutex mutex;
+    uint64_t last_offset{0};  // 最近写完还没有丢弃的chunk，由 mutex 保护
+    uint64_t last_length{0};
+};
+
+struct StageHeader;
+struct StagingProducer;
+class CompressorPool;
 }  // namespace detail
 
 class EffectiveSink final : public Sink {
 public:
+    // 加密粒度
+    enum class CryptScope {
+        kItem,   // 每个item (单条日志或压缩块) 写入缓存前加密，缓存中始终是密文
+        kChunk,  // 缓存中只压缩不加密，落盘前整个chunk一次性CTR加密，崩溃时缓存文件里是未加密的压缩数据
+    };
+
+    // 所有缓存段都写满且都在等待落盘时的处理策略
+    enum class FullPolicy {
+        kBlock,  // 写入方等待最早的段落盘完成，不丢日志，磁盘卡顿时写入方也会被卡住
+        kDrop,   // 丢弃日志并计数，写入方不受磁盘影响
+        kSpill,  // 继续写当前段，段超出固定大小后按需扩容 (原双缓冲的行为)
+    };
+
+    // 持久化策略：主动同步缓存段和日志文件的程度，越靠后越不怕断电，同步的开销也越大
+    enum class Durability {
+        kNone,       // 不主动同步，依赖内核回写，断电时丢失尚未回写的部分
+        kAsync,      // 每个 sync_interval 对缓存段新写入的脏页发起回写，不等待
+        kSync,       // 每个 sync_interval 等待缓存段新写入的数据和日志文件落盘
+        kErrorSync,  // 同 kAsync，另外 error 及以上级别的日志进入缓存后立即等待缓存段落盘
+    };
+
     struct Config {
         std::filesystem::path dir;         // 文件目录
         std::string prefix;                // 文件名前缀，文件名命名格式：{prefix}_{datetime}.log
@@ -45,10 +144,39 @@ public:
         std::chrono::minutes interval{5};  // 淘汰查询间隔
         megabytes single_size{4};          // 单个日志大小 4M ->分片
         megabytes total_size{100};         // 总日志大小不超过100M 超过淘汰
+        kilobytes ring_size{0};            // 每个线程的暂存环大小，0 表示不使用暂存环，日志在调用线程直接写入缓存
+        kilobytes block_size{64};          // 暂存环模式下压缩块的大小上限，每块整体压缩成一个独立的帧
+        std::filesystem::path dict_path;   // zstd字典文件，为空不使用字典，解码时需要提供同一份字典
+        uint32_t compress_workers{0};      // 暂存环模式下并行压缩块的线程数，0 表示在task_runner_上串行压缩
+        crypt::CipherMode cipher_mode{crypt::CipherMode::kAesCbc};  // 加密模式，kAesCtr 需显式开启，无填充且密钥只扩展一次
+        CryptScope crypt_scope{CryptScope::kItem};                  // 加密粒度，kChunk 需要同时配置 kAesCtr
+        uint32_t cache_segments{2};        // mmap缓存段数量，写满的段排队落盘，写入方切换到下一个空闲段
+        kilobytes segment_size{512};       // 每个缓存段的大小
+        FullPolicy full_policy{FullPolicy::kSpill};
+        std::filesystem::path cache_dir;   // 缓存段文件目录，为空时与日志同目录；可以指向 tmpfs/hugetlbfs 使用大页
+        bool cache_populate{false};        // 缓存段映射时预先缺页，写入路径上不再缺页
+        bool cache_huge_pages{false};      // 缓存段按大页对齐并建议内核使用大页
+        double seal_ratio{0.8};            // 当前段数据超过容量的这个比例就封存落盘
+        // 自适应段大小：按观测到的写入速度和落盘耗时调整段大小，让每个段大约这么久落盘一次，
+        // 写入很少时也按这个间隔封存，0 表示关闭，段大小固定为 segment_size
+        std::chrono::milliseconds target_flush_interval{0};
+        kilobytes min_segment_size{64};     // 自适应模式下段大小的下限
+        kilobytes max_segment_size{16384};  // 自适应模式下段大小的上限
+        // 同时在途的落盘写入数，0 表示在落盘线程上逐个同步写入；大于 0 时段的写入异步完成后才回收，
+        // 慢写入不会卡住后续段的落盘
+        uint32_t io_depth{0};
+        FileWriter::Backend io_backend{FileWriter::Backend::kUring};  // 异步写入方式，io_uring 不可用时退回写线程
+        Durability durability{Durability::kNone};
+        std::chrono::milliseconds sync_interval{1000};  // 定期同步的间隔，只同步上次之后新写入的部分
+        // 析构时排空暂存环、封存当前段并等待落盘的最长时间，超时后剩下的段留在缓存文件中，下次启动时恢复
+        std::chrono::milliseconds shutdown_timeout{5000};
+        // 崩溃信号 (SIGSEGV SIGABRT 等) 时丢弃当前段写了一半的item，追加一条崩溃记录并在段头标记已封存，
+        // 下次启动时和其他遗留的段一样逐条校验后恢复；信号处理函数在进程内所有开启的sink之间共用
+        bool crash_hook{false};
     };
 
     explicit EffectiveSink(const Config& conf);
-    ~EffectiveSink() = default;
+    ~EffectiveSink();
 
     // 日志方法
     void Log(const LogMsg& msg) override;
@@ -57,19 +185,155 @@ public:
 
     void Flush() override;
 
+    // kDrop 策略下被丢弃的日志条数
+    uint64_t DroppedRecords() const {
+        return dropped_records_.load(std::memory_order_relaxed);
+    }
+
+    // 停止定时任务，在 timeout 内排空暂存环、封存当前段并等待所有段落盘，全部落盘返回 true
+    // 超时后不再落盘，剩下的段留在缓存文件中由下次启动恢复；之后仍可以写入，但只进入缓存
+    // 析构时以 shutdown_timeout 自动调用，丢弃的条数见 DroppedRecords
+    bool Shutdown(std::chrono::milliseconds timeout);
+
 private:
-    // 写入到缓存
-    void WriteToCache(const void* data, uint32_t size);
+    struct SiteDef {  // 生产者提交的调用点目录项
+        std::string data;
+        bool with_fmt = false;
+    };
+
+    bool UseStaging() const {
+        return conf_.ring_size.count() > 0;
+    }
+
+    void LogDirect(const LogMsg& msg, const MemoryBuffer& buf);
+
+    // 暂存环 生产者
+    void StageLog(const LogMsg& msg, const MemoryBuffer& buf);
+
+    void Stage(detail::StagingProducer* producer, const detail::StageHeader& header, const MemoryBuffer& buf);
+
+    detail::StagingProducer* GetProducer();
+
+    void ScheduleDrain();
+
+    // 暂存环 消费者
+    void DrainStaging();
+
+    void WriteStaged(const uint8_t* data, uint32_t size);
+
+    // 追加到当前压缩块，块满了整块压缩加密写入缓存
+    void AppendBlock(const void* data, uint32_t size);
+
+    void FlushBlock();
+
+    // 压缩线程上执行，返回压缩后的块，失败返回空
+    std::string CompressBlockTask(const std::string& block);
+
+    // 按提交顺序把压缩完成的块加密写入缓存，wait 为 true 时等待所有块完成
+    void WriteCompressedBlocks(bool wait);
+
+    // 当前段为空时开始新的chunk，返回 false 表示损坏的chunk封存不了，这次写入需要丢弃
+    bool BeginChunkIfNeeded();
+
+    // 有item没能写入缓存时调用：重置压缩流，当前chunk不再追加，下一个chunk开始前封存
+    void BreakChunk();
+
+    // 封存损坏的chunk，kBlock 策略等待空闲段，其他策略没有空闲段时返回 false
+    bool SealBrokenChunk();
 
-    // 判断主cache容量
-    bool NeedSwapCache();
+    // 流式压缩 + 加密 后写入缓存
+    void WriteItem(const void* data, size_t size);
 
-    // 交换主从cache
-    void SwapCache();
+    // 缓存中不加密或者是CTR流加密时，压缩输出直接写入缓存并原地加密
+    bool ZeroCopy() const {
+        return conf_.crypt_scope == CryptScope::kChunk || conf_.cipher_mode == crypt::CipherMode::kAesCtr;
+    }
 
-    // 缓存手动落盘
+    void CompressToCache(const void* data, size_t size, uint32_t magic);
+
+    void EncryptToCache(const void* data, size_t size, uint32_t magic);
+
+    // 写入调用点目录项
+    void WriteSite(const LogMsg& msg);
+
+    bool NeedWriteSite(uint32_t site_id, bool need_fmt);
+
+    void MarkSiteWritten(uint32_t site_id, bool with_fmt);
+
+    // 写入到缓存，失败返回 false
+    bool WriteToCache(const void* data, uint32_t size, uint32_t magic);
+
+    MMapHandle* ActiveCache() const {
+        return segments_[active_].get();
+    }
+
+    // 当前段是否接近写满
+    bool NeedSealCache();
+
+    // 当前段写满时切换到空闲段，没有空闲段时按 full_policy 处理，返回 false 表示这次写入需要丢弃
+    bool EnsureCacheSpace();
+
+    // 排空时在每个块开始前调用：当前段写满时先把压缩中的块写入缓存，再按 EnsureCacheSpace 切换段
+    bool EnsureBlockSpace();
+
+    // 当前段排队落盘并切换到下一个空闲段，没有空闲段返回 false，调用方需持有 mutex_
+    bool SealCache();
+
+    void SealCacheIfNeeded();
+
+    // 缓存段落盘，每次处理最早排队的一个段
     void CacheToFile();
 
+    detail::ChunkHeader MakeChunkHeader(const MMapHandle& cache);
+
+    // chunk 头写入当前日志文件后，明文数据由内核直接从缓存文件拷贝，只有整chunk加密时经过用户态
+    bool WriteChunk(const MMapHandle& cache);
+
+    bool WriteEncryptedChunk(int fd, const MMapHandle& cache);
+
+    // 整chunk加密到 out
+    void EncryptChunk(const MMapHandle& cache, std::string* out);
+
+    // 提交到 writer_ 异步写入，写入完成后在写入器的线程上调用 done
+    void WriteChunkAsync(const MMapHandle& cache, std::function<void()> done);
+
+    // 落盘完成的段清空后放回空闲队列，latency 为该段的落盘耗时
+    void RecycleSegment(size_t index, double latency);
+
+    // 等待排队的段全部落盘，包括异步写入中的段
+    void WaitFlushIdle();
+
+    // 同步写入中和等待落盘的缓存段的脏页，wait 为 true 时等待落盘
+    void SyncCaches(bool wait);
+
+    // 定期同步 按 durability 同步缓存段，kSync 下同时等待日志文件落盘
+    void SyncByInterval();
+
+    // 启动时打开段环，上次未落盘的段改名为恢复文件后换上新段，写入方不需要等待恢复
+    void RecoverCaches();
+
+    // 在落盘线程上按写入顺序把恢复文件写入日志文件后删除，排在所有新段之前
+    void RecoverLeftovers(const std::vector<std::filesystem::path>& files);
+
+    // 崩溃信号处理：封存所有开启了 crash_hook 的sink的当前段，异步信号安全
+    static void OnCrashSignal(int signal);
+
+    void SealOnCrash(int signal);
+
+    bool Adaptive() const {
+        return conf_.target_flush_interval.count() > 0;
+    }
+
+    // 自适应模式：按封存的段统计写入速度，更新封存阈值，调用方需持有 mutex_
+    void UpdateSealTarget(size_t size, std::chrono::steady_clock::duration elapsed);
+
+    // 自适应模式：当前段写入超过目标间隔就封存，写入很少时也按节奏落盘
+    void SealByInterval();
+
+    const std::filesystem::path& CacheDir() const {
+        return conf_.cache_dir.empty() ? conf_.dir : conf_.cache_dir;
+    }
+
     // 异步落盘
     void PrepareCacheToFile();
 
@@ -78,26 +342,75 @@ private:
 
     std::filesystem::path GetLogFilePath();
 
+    // 当前日志文件，日志分片或者文件被删除后重新打开，只在落盘路径上调用，打开失败返回空
+    std::shared_ptr<detail::LogFile> GetLogFile();
+
+    std::unique_ptr<compress::Compression> CreateCompression();
+
 private:
     Config conf_;
+    uint64_t sink_id_;
     std::mutex mutex_;
 
-    std::unique_ptr<MMapHandle> master_cache_;
-    std::unique_ptr<MMapHandle> slave_cache_;
-    std::atomic<bool> slave_is_free_{true};
+    // 缓存段环：active_ 正在写入，sealed_ 按顺序等待落盘，free_segments_ 空闲，都由 mutex_ 保护
+    std::vector<std::unique_ptr<MMapHandle>> segments_;
+    size_t active_{0};
+    std::deque<size_t> sealed_;
+    std::deque<size_t> free_segments_;
+    uint64_t segment_seq_{0};
+    std::condition_variable_any segment_freed_;  // 直接等待 mutex_，写入路径上只有 lock_guard
+
+    // 自适应段大小，都由 mutex_ 保护
+    size_t seal_bytes_{0};                              // 当前段写到这么大就封存
+    std::chrono::steady_clock::time_point chunk_start_;  // 当前段开始写入的时间
+    bool chunk_broken_{false};                          // 当前chunk丢了item，后续的item无法解码
+    double ingest_rate_{0};                             // 写入速度 字节/秒，指数平均
+    double flush_latency_{0};                           // 单个段落盘耗时 秒，指数平均
+    std::atomic<uint64_t> dropped_records_{0};
+    std::atomic<bool> flush_abandoned_{false};  // 关闭超时，不再落盘，阻塞策略的写入方也不再等待
+    std::atomic<MMapHandle*> crash_segment_{nullptr};  // 当前段，信号处理函数不能加锁，切换段时同步更新
+
+    std::mutex sync_mutex_;                        // 同步缓存段期间段不会被清空回收，先于 mutex_ 加锁
+    std::atomic<bool> log_dirty_{false};           // 日志文件有尚未 fdatasync 的写入
+    std::atomic<bool> error_sync_pending_{false};  // 暂存环模式下有 error 日志等待排空后同步
 
     std::unique_ptr<compress::Compression> compress_;
     std::unique_ptr<crypt::Crypt> crypt_;
+    std::unique_ptr<crypt::Crypt> chunk_crypt_;  // 整chunk加密，只在flush_runner_上使用，恢复的缓存也可能需要
+
+    // 并行压缩：每个压缩任务独占一个压缩器，压缩结果按提交顺序排队
+    std::unique_ptr<detail::CompressorPool> compressors_;
+    std::unique_ptr<ThreadPool> compress_pool_;
+    std::deque<std::future<std::string>> compressing_blocks_;
 
     std::unique_ptr<Formatter> formatter_ptr_;
 
     ctx::TaskRunnerTag task_runner_;
+    ctx::TaskRunnerTag flush_runner_;  // 落盘单独一个线程，kBlock 策略下排空任务等待落盘时不会互相卡死
+    std::vector<ctx::RepeatedTaskID> repeated_tasks_;  // 析构时取消
 
     std::filesystem::path log_file_path_;
+    std::shared_ptr<detail::LogFile> log_file_;
+    std::unique_ptr<FileWriter> writer_;  // io_depth 大于 0 时异步落盘，完成回调会访问段环，析构时最先释放
 
     std::string client_pub_key_;
-    std::string compress_buf_;
-    std::string encrypted_buf_;
+    std::string dict_data_;
+    uint32_t dict_id_{0};
+    std::string compress_buf_;   // CBC模式下的压缩输出
+    std::string encrypted_buf_;  // CBC模式下的加密输出，密文带填充，不能原地加密
+
+    // 调用点目录状态：下标为调用点ID，值为 (写入时的chunk序号 << 1) | 是否带格式串
+    uint64_t chunk_epoch_{1};
+    std::vector<uint64_t> site_states_;
+    MemoryBuffer site_buf_;
+
+    // 暂存环
+    std::mutex producers_mutex_;
+    std::vector<std::shared_ptr<detail::StagingProducer>> producers_;
+    std::vector<std::shared_ptr<detail::StagingProducer>> drain_list_;
+    std::atomic<bool> drain_pending_{false};
+    std::vector<SiteDef> site_defs_;
+    std::string block_buf_;
 };
 
 };  // namespace logger
\ No newline at end of file
@@ -0,0 +1,108 @@
+#include "crc32c.h"
+
+#include <array>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <nmmintrin.h>
+#define LOGGER_CRC32C_SSE42 1
+#ifdef _MSC_VER
+#include <intrin.h>
+#define LOGGER_TARGET_SSE42
+#else
+#define LOGGER_TARGET_SSE42 __attribute__((target("sse4.2")))
+#endif
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#include <arm_acle.h>
+#define LOGGER_CRC32C_ARM 1
+#endif
+
+namespace logger {
+
+namespace {
+
+constexpr uint32_t kPolynomial = 0x82f63b78;  // 0x1edc6f41 按位反转
+
+constexpr std::array<uint32_t, 256> MakeTable() {
+    std::array<uint32_t, 256> table{};
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int bit = 0; bit < 8; ++bit) {
+            crc = (crc >> 1) ^ ((crc & 1) ? kPolynomial : 0);
+        }
+        table[i] = crc;
+    }
+    return table;
+}
+
+constexpr std::array<uint32_t, 256> kTable = MakeTable();
+
+uint32_t ExtendSoftware(uint32_t crc, const uint8_t* data, size_t size) {
+    for (size_t i = 0; i < size; ++i) {
+        crc = kTable[(crc ^ data[i]) & 0xff] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef LOGGER_CRC32C_SSE42
+
+bool HasSse42() {
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return info[2] & (1 << 20);
+#else
+    return __builtin_cpu_supports("sse4.2");
+#endif
+}
+
+LOGGER_TARGET_SSE42 uint32_t ExtendHardware(uint32_t crc, const uint8_t* data, size_t size) {
+    uint64_t crc64 = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+    for (; size > 0; ++data, --size) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+
+#elif defined(LOGGER_CRC32C_ARM)
+
+uint32_t ExtendHardware(uint32_t crc, const uint8_t* data, size_t size) {
+    for (; size >= 8; data += 8, size -= 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc = __crc32cd(crc, word);
+    }
+    for (; size > 0; ++data, --size) {
+        crc = __crc32cb(crc, *data);
+    }
+    return crc;
+}
+
+#endif
+
+using ExtendFunc = uint32_t (*)(uint32_t, const uint8_t*, size_t);
+
+ExtendFunc ChooseExtend() {
+#if defined(LOGGER_CRC32C_SSE42)
+    return HasSse42() ? ExtendHardware : ExtendSoftware;
+#elif defined(LOGGER_CRC32C_ARM)
+    return ExtendHardware;  // 编译时已经确定支持 CRC 扩展
+#else
+    return ExtendSoftware;
+#endif
+}
+
+}  // namespace
+
+uint32_t Crc32c(const void* data, size_t size, uint32_t crc) {
+    static const ExtendFunc extend = ChooseExtend();
+    return ~extend(~crc, static_cast<const uint8_t*>(data), size);
+}
+
+}  // namespace logger
@@ -0,0 +1,12 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace logger {
+
+// CRC32C (Castagnoli)，x86 上使用 SSE4.2 的 crc32 指令，ARMv8 上使用 CRC 扩展，都不支持时查表计算
+// crc 为之前数据的结果，可以分段计算：Crc32c(b, Crc32c(a)) 等于 a b 拼接后的结果
+uint32_t Crc32c(const void* data, size_t size, uint32_t crc = 0);
+
+}  // namespace logger
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace logger {
+
+// 异步写文件：同时有多个写入在途，每个写入完成后在写入器的线程上回调
+// io_uring 提交失败的写入退回同步 pwritev，在调用 Write 的线程上回调
+class FileWriter {
+public:
+    enum class Backend {
+        kThread,  // pwritev 线程池
+        kUring,   // io_uring，内核不支持时退回 kThread
+    };
+
+    struct Span {
+        const void* data;
+        size_t size;
+    };
+
+    // 写入全部完成或者出错后调用，数据在回调之前必须保持有效，回调之后使用者可以释放
+    using Callback = std::function<void(bool ok)>;
+
+    virtual ~FileWriter() = default;
+
+    // 把 spans 依次写到 fd 的 offset 处，在途的写入达到 depth 时阻塞到有写入完成
+    virtual void Write(int fd, uint64_t offset, std::vector<Span> spans, Callback done) = 0;
+
+    // 等待已提交的写入全部完成并回调
+    virtual void Wait() = 0;
+
+    // 最多等到 deadline，写入全部完成返回 true
+    virtual bool WaitUntil(std::chrono::steady_clock::time_point deadline) = 0;
+
+    static std::unique_ptr<FileWriter> Create(Backend backend, size_t depth);
+};
+
+namespace detail {
+// io_uring_enter 系统调用，失败返回 -1 并设置 errno；测试中替换以模拟提交失败
+using UringEnterFn = int (*)(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags);
+extern UringEnterFn uring_enter;
+}  // namespace detail
+
+}  // namespace logger
@@ -0,0 +1,377 @@
+#include "file_writer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+#include <errno.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#define LOGGER_HAS_IO_URING 1
+#endif
+
+#include "internal_log.h"
+#include "thread_pool.h"
+
+namespace logger {
+
+namespace detail {
+#ifdef LOGGER_HAS_IO_URING
+static int RawUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, ring_fd, to_submit, min_complete, flags, nullptr, 0));
+}
+UringEnterFn uring_enter = RawUringEnter;
+#else
+UringEnterFn uring_enter = nullptr;
+#endif
+}  // namespace detail
+
+namespace {
+
+std::vector<iovec> ToIovec(const std::vector<FileWriter::Span>& spans) {
+    std::vector<iovec> iov;
+    iov.reserve(spans.size());
+    for (auto& span : spans) {
+        iov.push_back({const_cast<void*>(span.data), span.size});
+    }
+    return iov;
+}
+
+// 从 index 开始跳过已经写入的 written 字节，返回剩余部分的第一个 iovec 下标
+size_t SkipWritten(std::vector<iovec>* iov, size_t index, size_t written) {
+    while (index < iov->size() && written >= (*iov)[index].iov_len) {
+        written -= (*iov)[index].iov_len;
+        ++index;
+    }
+    if (index < iov->size()) {
+        (*iov)[index].iov_base = static_cast<uint8_t*>((*iov)[index].iov_base) + written;
+        (*iov)[index].iov_len -= written;
+    }
+    return index;
+}
+
+// 同步写入剩余的全部数据，部分写入时继续
+bool WriteAll(int fd, uint64_t offset, std::vector<iovec> iov, size_t written) {
+    offset += written;
+    size_t index = SkipWritten(&iov, 0, written);
+    while (index < iov.size()) {
+        int count = static_cast<int>(std::min<size_t>(iov.size() - index, IOV_MAX));
+        ssize_t n = pwritev(fd, iov.data() + index, count, offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            return false;
+        }
+        offset += n;
+        index = SkipWritten(&iov, index, n);
+    }
+    return true;
+}
+
+size_t TotalSize(const std::vector<FileWriter::Span>& spans) {
+    size_t size = 0;
+    for (auto& span : spans) {
+        size += span.size;
+    }
+    return size;
+}
+
+// 限制在途的写入数量
+class LimitedFileWriter : public FileWriter {
+public:
+    explicit LimitedFileWriter(size_t depth) : depth_(depth) {}
+
+    void Wait() override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return inflight_ == 0; });
+    }
+
+    bool WaitUntil(std::chrono::steady_clock::time_point deadline) override {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return cv_.wait_until(lock, deadline, [this]() { return inflight_ == 0; });
+    }
+
+protected:
+    void Acquire() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [this]() { return inflight_ < depth_; });
+        ++inflight_;
+    }
+
+    void Release() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            --inflight_;
+        }
+        cv_.notify_all();
+    }
+
+    size_t depth_;
+
+private:
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    size_t inflight_{0};
+};
+
+// 每个线程同步 pwritev，depth 个线程同时写入
+class ThreadFileWriter final : public LimitedFileWriter {
+public:
+    explicit ThreadFileWriter(size_t depth) : LimitedFileWriter(depth), pool_(depth) {
+        pool_.Start();
+    }
+
+    ~ThreadFileWriter() override {
+        Wait();
+    }
+
+    void Write(int fd, uint64_t offset, std::vector<Span> spans, Callback done) override {
+        Acquire();
+        pool_.Submit([this, fd, offset, spans = std::move(spans), done = std::move(done)]() {
+            bool ok = WriteAll(fd, offset, ToIovec(spans), 0);
+            done(ok);
+            Release();
+        });
+    }
+
+private:
+    ThreadPool pool_;
+};
+
+#ifdef LOGGER_HAS_IO_URING
+
+// 直接使用 io_uring 系统调用，不依赖 liburing
+// 落盘线程提交 IORING_OP_WRITEV，收割线程阻塞等待完成事件并回调
+class UringFileWriter final : public LimitedFileWriter {
+public:
+    explicit UringFileWriter(size_t depth) : LimitedFileWriter(depth) {}
+
+    ~UringFileWriter() override {
+        if (ring_fd_ == -1) {
+            return;
+        }
+        if (reaper_.joinable()) {
+            Wait();
+            stopping_.store(true);
+            Submit(IORING_OP_NOP, -1, 0, nullptr, 0, kStopData);  // 唤醒收割线程退出
+            reaper_.join();
+        }
+        if (sqes_) {
+            munmap(sqes_, sqes_len_);
+        }
+        if (cq_ptr_ && cq_ptr_ != sq_ptr_) {
+            munmap(cq_ptr_, cq_len_);
+        }
+        if (sq_ptr_) {
+            munmap(sq_ptr_, sq_len_);
+        }
+        close(ring_fd_);
+    }
+
+    bool Init() {
+        io_uring_params params;
+        memset(&params, 0, sizeof(params));
+        ring_fd_ = static_cast<int>(syscall(__NR_io_uring_setup, static_cast<unsigned>(depth_), &params));
+        if (ring_fd_ == -1) {
+            LOG_ERROR("UringFileWriter: io_uring_setup failed: {}", errno);
+            return false;
+        }
+
+        sq_len_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_len_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_len_ = cq_len_ = std::max(sq_len_, cq_len_);
+        }
+        sq_ptr_ = MapRing(sq_len_, IORING_OFF_SQ_RING);
+        cq_ptr_ = single_mmap ? sq_ptr_ : MapRing(cq_len_, IORING_OFF_CQ_RING);
+        sqes_len_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe*>(MapRing(sqes_len_, IORING_OFF_SQES));
+        if (!sq_ptr_ || !cq_ptr_ || !sqes_) {
+            return false;
+        }
+
+        uint8_t* sq = static_cast<uint8_t*>(sq_ptr_);
+        sq_head_ = reinterpret_cast<unsigned*>(sq + params.sq_off.head);
+        sq_tail_ = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+        sq_mask_ = *reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+        uint8_t* cq = static_cast<uint8_t*>(cq_ptr_);
+        cq_head_ = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+        cq_mask_ = *reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe*>(cq + params.cq_off.cqes);
+
+        reaper_ = std::thread([this]() { Reap(); });
+        return true;
+    }
+
+    void Write(int fd, uint64_t offset, std::vector<Span> spans, Callback done) override {
+        Acquire();
+        auto request = new Request{fd, offset, TotalSize(spans), ToIovec(spans), std::move(done)};
+        if (Submit(IORING_OP_WRITEV,
+                   fd,
+                   offset,
+                   request->iov.data(),
+                   static_cast<unsigned>(request->iov.size()),
+                   reinterpret_cast<uint64_t>(request))) {
+            return;
+        }
+
+        // 内核没有接收这个请求，不会有完成事件，在当前线程上同步写入
+        std::unique_ptr<Request> owned(request);
+        bool ok = WriteAll(owned->fd, owned->offset, std::move(owned->iov), 0);
+        if (!ok) {
+            LOG_ERROR("UringFileWriter: write {} bytes failed: {}", owned->size, errno);
+        }
+        owned->done(ok);
+        owned.reset();
+        Release();
+    }
+
+private:
+    static constexpr uint64_t kStopData = 0;
+    static constexpr int kSubmitRetries = 64;  // 提交队列或完成队列暂时满时的重试次数，之后按失败处理
+
+    struct Request {
+        int fd;
+        uint64_t offset;
+        size_t size;
+        std::vector<iovec> iov;
+        Callback done;
+    };
+
+    void* MapRing(size_t length, off_t offset) {
+        void* addr = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd_, offset);
+        if (addr == MAP_FAILED) {
+            LOG_ERROR("UringFileWriter: mmap ring {} failed: {}", offset, errno);
+            return nullptr;
+        }
+        return addr;
+    }
+
+    // 在途的写入不超过 depth，提交队列不会满；完成队列是提交队列的两倍，不会溢出
+    // 内核没有接收时收回SQE并返回 false，调用方自行完成请求，收割线程不会等待一个不存在的完成事件
+    bool Submit(uint8_t opcode, int fd, uint64_t offset, const iovec* iov, unsigned count, uint64_t user_data) {
+        std::lock_guard<std::mutex> lock(submit_mutex_);
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & sq_mask_;
+        io_uring_sqe* sqe = &sqes_[index];
+        memset(sqe, 0, sizeof(*sqe));
+        sqe->opcode = opcode;
+        sqe->fd = fd;
+        sqe->off = offset;
+        sqe->addr = reinterpret_cast<uint64_t>(iov);
+        sqe->len = count;
+        sqe->user_data = user_data;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+
+        int retries = 0;
+        while (detail::uring_enter(ring_fd_, 1, 0, 0) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            if ((errno == EAGAIN || errno == EBUSY) && ++retries <= kSubmitRetries) {
+                // 内核资源或完成队列暂时不足，退避等收割线程取走完成事件后再提交
+                std::this_thread::sleep_for(std::chrono::microseconds(50 << std::min(retries, 6)));
+                continue;
+            }
+            LOG_ERROR("UringFileWriter: io_uring_enter submit failed: {}", errno);
+            // 没有 SQPOLL，SQE 只在 io_uring_enter 中被内核取走，持有 submit_mutex_ 时队列头不会再变化
+            if (__atomic_load_n(sq_head_, __ATOMIC_ACQUIRE) == tail) {
+                __atomic_store_n(sq_tail_, tail, __ATOMIC_RELEASE);
+                return false;
+            }
+            break;
+        }
+        return true;
+    }
+
+    void Reap() {
+        while (true) {
+            unsigned head = *cq_head_;
+            if (head == __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+                // 停止用的NOP提交失败时不会有完成事件，等待出错返回后直接退出
+                if (detail::uring_enter(ring_fd_, 0, 1, IORING_ENTER_GETEVENTS) == -1 && errno != EINTR &&
+                    stopping_.load()) {
+                    return;
+                }
+                continue;
+            }
+            io_uring_cqe cqe = cqes_[head & cq_mask_];
+            __atomic_store_n(cq_head_, head + 1, __ATOMIC_RELEASE);
+            if (cqe.user_data == kStopData) {
+                return;
+            }
+
+            std::unique_ptr<Request> request(reinterpret_cast<Request*>(cqe.user_data));
+            bool ok = cqe.res >= 0;
+            if (ok && static_cast<size_t>(cqe.res) < request->size) {  // 部分写入，剩余部分同步写完
+                ok = WriteAll(request->fd, request->offset, std::move(request->iov), cqe.res);
+            }
+            if (!ok) {
+                LOG_ERROR("UringFileWriter: write {} bytes failed: {}", request->size, cqe.res);
+            }
+            request->done(ok);
+            request.reset();
+            Release();
+        }
+    }
+
+private:
+    int ring_fd_{-1};
+    void* sq_ptr_{nullptr};
+    void* cq_ptr_{nullptr};
+    size_t sq_len_{0};
+    size_t cq_len_{0};
+    io_uring_sqe* sqes_{nullptr};
+    size_t sqes_len_{0};
+
+    std::mutex submit_mutex_;
+    unsigned* sq_head_{nullptr};
+    unsigned* sq_tail_{nullptr};
+    unsigned sq_mask_{0};
+    unsigned* sq_array_{nullptr};
+
+    unsigned* cq_head_{nullptr};
+    unsigned* cq_tail_{nullptr};
+    unsigned cq_mask_{0};
+    io_uring_cqe* cqes_{nullptr};
+
+    std::thread reaper_;
+    std::atomic<bool> stopping_{false};
+};
+
+#endif  // LOGGER_HAS_IO_URING
+
+}  // namespace
+
+std::unique_ptr<FileWriter> FileWriter::Create(Backend backend, size_t depth) {
+    depth = std::max<size_t>(depth, 1);
+#ifdef LOGGER_HAS_IO_URING
+    if (backend == Backend::kUring) {
+        auto writer = std::make_unique<UringFileWriter>(depth);
+        if (writer->Init()) {
+            return writer;
+        }
+    }
+#endif
+    if (backend == Backend::kUring) {
+        LOG_ERROR("FileWriter: io_uring is unavailable, fallback to pwrite threads");
+    }
+    return std::make_unique<ThreadFileWriter>(depth);
+}
+
+}  // namespace logger
@@ -3,6 +3,7 @@
 #include <time.h>
 #include <cstdint>
 #include <ctime>
+#include <filesystem>
 #include <string>
 
 namespace logger {
@@ -15,4 +16,39 @@ size_t GetThreadId();
 
 void LocalTime(std::tm* tm, std::time_t* now);
 
+// 以追加方式打开文件用于写入，文件不存在时创建，失败返回 -1
+// 不带 O_APPEND 标志，而是把偏移移到文件末尾，copy_file_range 不接受 O_APPEND 的目标文件
+int OpenAppendFile(const std::filesystem::path& path);
+
+void CloseFile(int fd);
+
+// 等待文件数据落盘 (fdatasync)
+bool DataSync(int fd);
+
+// 为文件预留 [0, size) 的磁盘块，不改变文件大小，之后追加写入的数据在磁盘上保持连续
+bool PreallocateFile(int fd, size_t size);
+
+// 把文件截断到实际大小，归还预留了但没有写入的磁盘块
+bool TrimPreallocated(int fd);
+
+// 对 [offset, offset + length) 的脏页发起回写，不等待
+void StartWriteback(int fd, size_t offset, size_t length);
+
+// 等待 [offset, offset + length) 回写完成，再把这段页从页缓存中丢弃
+void DropPageCache(int fd, size_t offset, size_t length);
+
+// 写入全部数据，被信号打断或者部分写入时继续
+bool WriteFile(int fd, const void* data, size_t size);
+
+// 把 src_fd 从 offset 开始的 size 字节追加写入 dst_fd 的当前位置，
+// 依次尝试 copy_file_range、sendfile，数据不经过用户态，都不支持时退回读写
+bool CopyFileRange(int src_fd, size_t offset, int dst_fd, size_t size);
+
+// 崩溃信号 (SIGSEGV SIGABRT SIGBUS SIGFPE SIGILL) 的回调，在信号处理函数中执行，只能做异步信号安全的操作
+using CrashHandler = void (*)(int signal);
+
+// 安装崩溃信号处理函数，回调执行完后恢复之前的处理方式并重新触发信号，原有的处理函数和 core dump 不受影响
+// 只安装一次，之后再调用只替换回调
+void InstallCrashHandler(CrashHandler handler);
+
 }  // namespace logger
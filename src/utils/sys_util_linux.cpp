@@ -1,10 +1,37 @@
-
 #include "sys_util.h"
 
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
 #include <unistd.h>
 
 namespace logger {
 
+namespace {
+
+constexpr int kCrashSignals[] = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL};
+
+std::atomic<CrashHandler> crash_handler{nullptr};
+struct sigaction previous_actions[NSIG];
+
+void OnCrashSignal(int signal, siginfo_t*, void*) {
+    CrashHandler handler = crash_handler.load();
+    if (handler) {
+        handler(signal);
+    }
+    // 交还给之前的处理方式：默认行为直接终止进程并生成 core dump，硬件异常返回后会在原地再次触发
+    sigaction(signal, &previous_actions[signal], nullptr);
+    raise(signal);
+}
+
+}  // namespace
+
 size_t GetPageSize() {
     return getpagesize();
 }
@@ -21,4 +48,120 @@ void LocalTime(std::tm* tm, std::time_t* now) {
     localtime_r(now, tm);
 }
 
+int OpenAppendFile(const std::filesystem::path& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_CLOEXEC, 0666);
+    if (fd == -1) {
+        return -1;
+    }
+    if (lseek(fd, 0, SEEK_END) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+void CloseFile(int fd) {
+    if (fd != -1) {
+        close(fd);
+    }
+}
+
+bool DataSync(int fd) {
+    return fdatasync(fd) == 0;
+}
+
+bool PreallocateFile(int fd, size_t size) {
+    return fallocate(fd, FALLOC_FL_KEEP_SIZE, 0, size) == 0;
+}
+
+bool TrimPreallocated(int fd) {
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        return false;
+    }
+    return ftruncate(fd, st.st_size) == 0;
+}
+
+void StartWriteback(int fd, size_t offset, size_t length) {
+    sync_file_range(fd, offset, length, SYNC_FILE_RANGE_WRITE);
+}
+
+void DropPageCache(int fd, size_t offset, size_t length) {
+    // 只丢弃干净的页，脏页需要先等回写完成；回写已经提前发起，这里通常不需要等待
+    sync_file_range(
+            fd, offset, length, SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE | SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise(fd, offset, length, POSIX_FADV_DONTNEED);
+}
+
+bool WriteFile(int fd, const void* data, size_t size) {
+    const uint8_t* ptr = static_cast<const uint8_t*>(data);
+    while (size > 0) {
+        ssize_t n = write(fd, ptr, size);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        ptr += n;
+        size -= n;
+    }
+    return true;
+}
+
+// 内核不支持或者两个文件不在同一个文件系统上时返回 false，已拷贝的部分通过 offset 和 size 带回
+static bool CopyBySyscall(int src_fd, off_t* offset, int dst_fd, size_t* size, bool use_sendfile) {
+    while (*size > 0) {
+        ssize_t n = use_sendfile ? sendfile(dst_fd, src_fd, offset, *size)
+                                 : copy_file_range(src_fd, offset, dst_fd, nullptr, *size, 0);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {  // 源文件提前结束也交给读写路径处理
+            return false;
+        }
+        *size -= n;
+    }
+    return true;
+}
+
+bool CopyFileRange(int src_fd, size_t offset, int dst_fd, size_t size) {
+    off_t src_offset = offset;
+    if (CopyBySyscall(src_fd, &src_offset, dst_fd, &size, false)) {
+        return true;
+    }
+    if (CopyBySyscall(src_fd, &src_offset, dst_fd, &size, true)) {
+        return true;
+    }
+
+    uint8_t buf[64 * 1024];
+    while (size > 0) {
+        ssize_t n = pread(src_fd, buf, std::min(size, sizeof(buf)), src_offset);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0 || !WriteFile(dst_fd, buf, n)) {
+            return false;
+        }
+        src_offset += n;
+        size -= n;
+    }
+    return true;
+}
+
+void InstallCrashHandler(CrashHandler handler) {
+    crash_handler.store(handler);
+
+    static std::once_flag installed;
+    std::call_once(installed, []() {
+        struct sigaction action {};
+        action.sa_sigaction = OnCrashSignal;
+        action.sa_flags = SA_SIGINFO | SA_ONSTACK;  // 线程设置了备用栈时在备用栈上执行，栈溢出时也能处理
+        sigemptyset(&action.sa_mask);
+        for (int signal : kCrashSignals) {
+            sigaction(signal, &action, &previous_actions[signal]);
+        }
+    });
+}
+
 }  // namespace logger
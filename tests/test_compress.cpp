@@ -3,6 +3,8 @@
 #include <vector>
 #include <cstring>
 
+#include <zdict.h>
+
 #include "compress/zlib_compress.h"
 #include "compress/zstd_compress.h"
 
@@ -209,3 +211,116 @@ TEST_F(ZstdCompressTest, MultipleCompressDecompress_Calls) {
     ASSERT_GT(l2, 0u);
     EXPECT_EQ(zc_.DeCompress(o2.data(), l2), s2);
 }
+
+TEST_F(ZstdCompressTest, CompressAndDecompress_Roundtrip_LargeBatch) {
+    // 解压输出远大于单次缓冲区，验证循环解压不截断
+    std::string input;
+    for (int i = 0; i < 20000; ++i) {
+        input += "record " + std::to_string(i) + ";";
+    }
+
+    size_t bound = zc_.CompressBound(input.size());
+    std::vector<uint8_t> out(bound, 0);
+    size_t out_len = zc_.Compress(input.data(), input.size(), out.data(), out.size());
+    ASSERT_GT(out_len, 0u);
+
+    std::string decompressed = zc_.DeCompress(out.data(), out_len);
+    EXPECT_EQ(decompressed, input);
+}
+
+TEST_F(ZstdCompressTest, CompressBlock_IndependentOfStream) {
+    // 流式压缩中间插入一个独立块，两边都应能正确解压
+    std::string s1 = "stream item one";
+    std::string block = std::string(5000, 'b') + "block tail";
+    std::string s2 = "stream item two";
+
+    std::vector<uint8_t> o1(zc_.CompressBound(s1.size()), 0);
+    size_t l1 = zc_.Compress(s1.data(), s1.size(), o1.data(), o1.size());
+    ASSERT_GT(l1, 0u);
+
+    std::vector<uint8_t> ob(zc_.CompressBound(block.size()), 0);
+    size_t lb = zc_.CompressBlock(block.data(), block.size(), ob.data(), ob.size());
+    ASSERT_GT(lb, 0u);
+
+    std::vector<uint8_t> o2(zc_.CompressBound(s2.size()), 0);
+    size_t l2 = zc_.Compress(s2.data(), s2.size(), o2.data(), o2.size());
+    ASSERT_GT(l2, 0u);
+
+    // 独立块可以单独解压
+    ZstdCompress other;
+    EXPECT_EQ(other.DeCompress(ob.data(), lb), block);
+
+    ZstdCompress stream;
+    EXPECT_EQ(stream.DeCompress(o1.data(), l1), s1);
+    EXPECT_EQ(stream.DeCompress(o2.data(), l2), s2);
+}
+
+TEST_F(ZstdCompressTest, CompressBlock_MixedWithStream_SingleDecoder) {
+    // 同一chunk里流式item和独立块交替出现，解码端只有一个解压器
+    std::string s1 = "stream item one";
+    std::string block = std::string(5000, 'b') + "block tail";
+    std::string s2 = "stream item two";
+
+    std::vector<uint8_t> o1(zc_.CompressBound(s1.size()), 0);
+    size_t l1 = zc_.Compress(s1.data(), s1.size(), o1.data(), o1.size());
+    ASSERT_GT(l1, 0u);
+
+    std::vector<uint8_t> ob(zc_.CompressBound(block.size()), 0);
+    size_t lb = zc_.CompressBlock(block.data(), block.size(), ob.data(), ob.size());
+    ASSERT_GT(lb, 0u);
+
+    std::vector<uint8_t> o2(zc_.CompressBound(s2.size()), 0);
+    size_t l2 = zc_.Compress(s2.data(), s2.size(), o2.data(), o2.size());
+    ASSERT_GT(l2, 0u);
+
+    ZstdCompress decoder;
+    EXPECT_EQ(decoder.DeCompress(o1.data(), l1), s1);
+    EXPECT_EQ(decoder.DeCompressBlock(ob.data(), lb), block);
+    EXPECT_EQ(decoder.DeCompress(o2.data(), l2), s2);
+}
+
+TEST_F(ZlibCompressTest, CompressBlock_Roundtrip) {
+    std::string block = std::string(3000, 'z') + "zlib block";
+
+    std::vector<uint8_t> out(zc_.CompressBound(block.size()), 0);
+    size_t out_len = zc_.CompressBlock(block.data(), block.size(), out.data(), out.size());
+    ASSERT_GT(out_len, 0u);
+
+    ZlibCompress other;
+    EXPECT_EQ(other.DeCompress(out.data(), out_len), block);
+    EXPECT_EQ(other.DeCompressBlock(out.data(), out_len), block);
+}
+
+TEST_F(ZstdCompressTest, Dictionary_SmallRecords) {
+    // 用相似的短记录训练字典，字典压缩后的短记录应明显更小
+    std::string samples;
+    std::vector<size_t> sample_sizes;
+    for (int i = 0; i < 2000; ++i) {
+        std::string record = "[info][main.cpp:42][HandleRequest] user " + std::to_string(i * 7919 % 10007) +
+                             " request done, cost " + std::to_string(i % 97) + "ms";
+        samples += record;
+        sample_sizes.push_back(record.size());
+    }
+    std::string dict(16 * 1024, '\0');
+    size_t dict_size = ZDICT_trainFromBuffer(
+            dict.data(), dict.size(), samples.data(), sample_sizes.data(), static_cast<unsigned>(sample_sizes.size()));
+    ASSERT_FALSE(ZDICT_isError(dict_size));
+    dict.resize(dict_size);
+
+    ZstdCompress with_dict;
+    ASSERT_TRUE(with_dict.LoadDictionary(dict.data(), dict.size()));
+    EXPECT_NE(with_dict.DictId(), 0u);
+
+    std::string input = "[info][main.cpp:42][HandleRequest] user 31337 request done, cost 12ms";
+    std::vector<uint8_t> plain_out(zc_.CompressBound(input.size()), 0);
+    size_t plain_len = zc_.CompressBlock(input.data(), input.size(), plain_out.data(), plain_out.size());
+    std::vector<uint8_t> dict_out(with_dict.CompressBound(input.size()), 0);
+    size_t dict_len = with_dict.CompressBlock(input.data(), input.size(), dict_out.data(), dict_out.size());
+    ASSERT_GT(plain_len, 0u);
+    ASSERT_GT(dict_len, 0u);
+    EXPECT_LT(dict_len, plain_len);
+
+    ZstdCompress decoder;
+    ASSERT_TRUE(decoder.LoadDictionary(dict.data(), dict.size()));
+    EXPECT_EQ(decoder.DeCompress(dict_out.data(), dict_len), input);
+}
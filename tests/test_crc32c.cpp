@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+#include "utils/crc32c.h"
+
+using namespace logger;
+
+// RFC 3720 B.4 中的测试向量
+TEST(Crc32cTest, KnownValues) {
+    EXPECT_EQ(Crc32c("", 0), 0u);
+    EXPECT_EQ(Crc32c("123456789", 9), 0xe3069283u);
+
+    std::vector<uint8_t> zeros(32, 0);
+    EXPECT_EQ(Crc32c(zeros.data(), zeros.size()), 0x8a9136aau);
+
+    std::vector<uint8_t> ones(32, 0xff);
+    EXPECT_EQ(Crc32c(ones.data(), ones.size()), 0x62a8ab43u);
+
+    std::vector<uint8_t> ascending(32);
+    for (size_t i = 0; i < ascending.size(); ++i) {
+        ascending[i] = static_cast<uint8_t>(i);
+    }
+    EXPECT_EQ(Crc32c(ascending.data(), ascending.size()), 0x46dd794eu);
+}
+
+// 分段计算与整体计算结果一致，起始地址不对齐也一样
+TEST(Crc32cTest, Extend) {
+    std::string data;
+    for (int i = 0; i < 1000; ++i) {
+        data.push_back(static_cast<char>(i * 31 + 7));
+    }
+    uint32_t whole = Crc32c(data.data(), data.size());
+    for (size_t split : {1, 7, 8, 9, 500, 999}) {
+        uint32_t crc = Crc32c(data.data(), split);
+        EXPECT_EQ(Crc32c(data.data() + split, data.size() - split, crc), whole) << split;
+    }
+
+    std::string shifted = "x" + data;
+    EXPECT_EQ(Crc32c(shifted.data() + 1, data.size()), whole);
+}
+
+TEST(Crc32cTest, DetectsCorruption) {
+    std::string data(4096, 'a');
+    uint32_t crc = Crc32c(data.data(), data.size());
+    data[2048] = 'b';
+    EXPECT_NE(Crc32c(data.data(), data.size()), crc);
+    data[2048] = 'a';
+    EXPECT_NE(Crc32c(data.data(), data.size() - 1), crc);
+}
@@ -2,6 +2,7 @@
 #include <cryptopp/cryptlib.h>
 
 #include "crypt/aes_crypt.h"
+#include "crypt/aes_ctr_crypt.h"
 #include "crypt/crypt.h"
 
 using namespace logger::crypt;
@@ -345,6 +346,91 @@ TEST_F(AESCryptTest, Decrypt_WrongKeyThrowsException) {
             << "Wrong key should throw exception during decryption";
 }
 
+// ============================================================================
+// 测试 AES-CTR 加密
+// ============================================================================
+
+class AESCtrCryptTest : public ::testing::Test {
+protected:
+    std::string key_ = std::string(32, 'K');
+};
+
+// 测试: 密文与明文等长，没有填充
+TEST_F(AESCtrCryptTest, Encrypt_NoPadding) {
+    AESCtrCrypt cipher(key_);
+    cipher.SetNonce(AESCtrCrypt::GenerateNonce());
+
+    for (size_t len : {1, 15, 16, 17, 100}) {
+        std::string message(len, 'x');
+        std::string encrypted;
+        cipher.Seek(0);
+        cipher.Encrypt(message.data(), message.size(), encrypted);
+        EXPECT_EQ(encrypted.size(), len) << "CTR ciphertext should have the same length";
+    }
+}
+
+// 测试: 按偏移定位密钥流，解密端只需知道 nonce 和偏移
+TEST_F(AESCtrCryptTest, EncryptDecrypt_SeekByOffset) {
+    std::string nonce = AESCtrCrypt::GenerateNonce();
+    AESCtrCrypt writer(key_);
+    writer.SetNonce(nonce);
+
+    std::string first = "first item";
+    std::string second = "second item, not aligned to block";
+    std::string encrypted_first;
+    std::string encrypted_second;
+    writer.Seek(8);
+    writer.Encrypt(first.data(), first.size(), encrypted_first);
+    writer.Seek(8 + first.size() + 8);
+    writer.Encrypt(second.data(), second.size(), encrypted_second);
+
+    // 乱序解密
+    AESCtrCrypt reader(key_);
+    reader.SetNonce(nonce);
+    reader.Seek(8 + first.size() + 8);
+    EXPECT_EQ(reader.Decrypt(encrypted_second.data(), encrypted_second.size()), second);
+    reader.Seek(8);
+    EXPECT_EQ(reader.Decrypt(encrypted_first.data(), encrypted_first.size()), first);
+}
+
+// 测试: 不同 nonce 产生不同密文
+TEST_F(AESCtrCryptTest, Encrypt_DifferentNonceProducesDifferentCiphertext) {
+    AESCtrCrypt cipher(key_);
+    std::string message = "same plaintext";
+
+    std::string encrypted1;
+    cipher.SetNonce(AESCtrCrypt::GenerateNonce());
+    cipher.Seek(0);
+    cipher.Encrypt(message.data(), message.size(), encrypted1);
+
+    std::string encrypted2;
+    cipher.SetNonce(AESCtrCrypt::GenerateNonce());
+    cipher.Seek(0);
+    cipher.Encrypt(message.data(), message.size(), encrypted2);
+
+    EXPECT_NE(encrypted1, encrypted2) << "Each chunk nonce should give a different keystream";
+}
+
+// 测试: 原地加密与拷贝加密结果一致，CBC 不支持原地加密
+TEST_F(AESCtrCryptTest, EncryptInPlace_MatchesEncrypt) {
+    std::string nonce = AESCtrCrypt::GenerateNonce();
+    AESCtrCrypt cipher(key_);
+    cipher.SetNonce(nonce);
+
+    std::string message = "payload written straight into the mmap cache";
+    std::string encrypted;
+    cipher.Seek(24);
+    cipher.Encrypt(message.data(), message.size(), encrypted);
+
+    std::string in_place = message;
+    cipher.Seek(24);
+    ASSERT_TRUE(cipher.EncryptInPlace(in_place.data(), in_place.size()));
+    EXPECT_EQ(in_place, encrypted);
+
+    AESCrypt cbc(key_);
+    EXPECT_FALSE(cbc.EncryptInPlace(in_place.data(), in_place.size()));
+}
+
 // ============================================================================
 // 测试 ECDH + AES 集成
 // ============================================================================
@@ -0,0 +1,157 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <cerrno>
+#include <filesystem>
+#include <fstream>
+#include <string>
+
+#include "utils/file_writer.h"
+#include "utils/sys_util.h"
+
+using namespace logger;
+
+class FileWriterTest : public ::testing::TestWithParam<FileWriter::Backend> {
+protected:
+    void SetUp() override {
+        test_file_ = std::filesystem::temp_directory_path() /
+                     ("test_file_writer_" + std::to_string(static_cast<int>(GetParam())) + ".log");
+        std::filesystem::remove(test_file_);
+    }
+
+    void TearDown() override {
+        std::filesystem::remove(test_file_);
+    }
+
+    std::string ReadAll() {
+        std::ifstream ifs(test_file_, std::ios::binary);
+        return std::string((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    }
+
+    std::filesystem::path test_file_;
+};
+
+TEST_P(FileWriterTest, WriteAtOffsets) {
+    // 多个写入同时在途，按提交时分配的位置写入，完成顺序不影响文件内容
+    constexpr size_t kChunks = 32;
+    constexpr size_t kChunkSize = 64 * 1024;
+    std::vector<std::string> heads;
+    std::vector<std::string> bodies;
+    std::string expect;
+    for (size_t i = 0; i < kChunks; ++i) {
+        heads.push_back("chunk" + std::to_string(i % 10));
+        bodies.push_back(std::string(kChunkSize, static_cast<char>('a' + i % 26)));
+        expect += heads.back() + bodies.back();
+    }
+
+    int fd = OpenAppendFile(test_file_);
+    ASSERT_NE(fd, -1);
+    auto writer = FileWriter::Create(GetParam(), 4);
+    std::atomic<size_t> completed{0};
+    std::atomic<size_t> failed{0};
+    uint64_t offset = 0;
+    for (size_t i = 0; i < kChunks; ++i) {
+        std::vector<FileWriter::Span> spans{{heads[i].data(), heads[i].size()}, {bodies[i].data(), bodies[i].size()}};
+        writer->Write(fd, offset, std::move(spans), [&](bool ok) {
+            failed += !ok;
+            ++completed;
+        });
+        offset += heads[i].size() + bodies[i].size();
+    }
+    writer->Wait();
+    EXPECT_EQ(completed.load(), kChunks);
+    EXPECT_EQ(failed.load(), 0);
+
+    writer.reset();
+    CloseFile(fd);
+    EXPECT_EQ(ReadAll(), expect);
+}
+
+TEST_P(FileWriterTest, WriteFailure) {
+    // 写入失败也要回调，使用者据此释放缓冲区
+    auto writer = FileWriter::Create(GetParam(), 2);
+    std::string data = "data";
+    std::atomic<int> result{-1};
+    writer->Write(-1, 0, {{data.data(), data.size()}}, [&](bool ok) { result = ok; });
+    writer->Wait();
+    EXPECT_EQ(result.load(), 0);
+}
+
+INSTANTIATE_TEST_SUITE_P(Backends,
+                         FileWriterTest,
+                         ::testing::Values(FileWriter::Backend::kThread, FileWriter::Backend::kUring));
+
+namespace {
+detail::UringEnterFn real_uring_enter = nullptr;
+std::atomic<int> failing_submits{0};
+std::atomic<int> submit_errno{0};
+
+// 前 failing_submits 次提交返回 submit_errno，等待完成事件照常进入内核
+int FailingUringEnter(int ring_fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    if (to_submit > 0 && failing_submits.fetch_sub(1) > 0) {
+        errno = submit_errno.load();
+        return -1;
+    }
+    return real_uring_enter(ring_fd, to_submit, min_complete, flags);
+}
+}  // namespace
+
+TEST(UringFileWriterTest, SubmitFailure) {
+    // 提交出错的写入不会有完成事件，退回同步写入并回调；暂时性错误重试后照常提交
+    auto path = std::filesystem::temp_directory_path() / "test_uring_submit_failure.log";
+    std::filesystem::remove(path);
+    int fd = OpenAppendFile(path);
+    ASSERT_NE(fd, -1);
+    auto writer = FileWriter::Create(FileWriter::Backend::kUring, 2);
+    real_uring_enter = detail::uring_enter;
+    detail::uring_enter = FailingUringEnter;
+
+    std::string first = "first-write;";
+    std::string second = "second-write;";
+    std::atomic<size_t> completed{0};
+    std::atomic<size_t> failed{0};
+    auto done = [&](bool ok) {
+        failed += !ok;
+        ++completed;
+    };
+
+    submit_errno = EINVAL;
+    failing_submits = 1;
+    writer->Write(fd, 0, {{first.data(), first.size()}}, done);
+    submit_errno = EAGAIN;
+    failing_submits = 3;
+    writer->Write(fd, first.size(), {{second.data(), second.size()}}, done);
+    writer->Wait();
+    EXPECT_EQ(completed.load(), 2u);
+    EXPECT_EQ(failed.load(), 0u);
+
+    failing_submits = 0;
+    writer.reset();
+    detail::uring_enter = real_uring_enter;
+    CloseFile(fd);
+    std::ifstream ifs(path, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, first + second);
+    std::filesystem::remove(path);
+}
+
+TEST(FileUtilTest, PreallocateAndTrim) {
+    // 预留的磁盘块不改变文件大小，截断后归还
+    auto path = std::filesystem::temp_directory_path() / "test_preallocate.log";
+    std::filesystem::remove(path);
+    int fd = OpenAppendFile(path);
+    ASSERT_NE(fd, -1);
+    std::string data(10000, 'x');
+    ASSERT_TRUE(WriteFile(fd, data.data(), data.size()));
+
+    if (PreallocateFile(fd, 4 * 1024 * 1024)) {  // 文件系统可能不支持
+        EXPECT_EQ(std::filesystem::file_size(path), data.size());
+        ASSERT_TRUE(WriteFile(fd, data.data(), data.size()));
+        EXPECT_EQ(std::filesystem::file_size(path), data.size() * 2);
+        EXPECT_TRUE(TrimPreallocated(fd));
+    }
+    StartWriteback(fd, 0, data.size());
+    DropPageCache(fd, 0, data.size());
+    CloseFile(fd);
+    EXPECT_EQ(std::filesystem::file_size(path) % data.size(), 0);
+    std::filesystem::remove(path);
+}
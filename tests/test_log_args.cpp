@@ -0,0 +1,162 @@
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+
+#include "log_args.h"
+#include "log_extension_handle.h"
+#include "logger.h"
+#include "sinks/sink.h"
+
+using namespace logger;
+
+namespace {
+struct Point {
+    int x;
+    int y;
+};
+
+// 记录sink收到的消息，验证延迟格式化的输出
+class CaptureSink final : public Sink {
+public:
+    void Log(const LogMsg& msg) override {
+        site_ = msg.site;
+        site_id_ = msg.site->Id();
+        file_name_ = std::string(msg.Location().file_name);
+        fmt_ = std::string(msg.message);
+        deferred_ = !msg.args.empty();
+        text_.clear();
+        detail::FormatLogMessage(msg, &text_);
+    }
+
+    void SetFormatter(std::unique_ptr<Formatter> formatter) override {}
+
+    const LogSite* site_ = nullptr;  // 只有静态的调用点在 Log 返回后仍然有效
+    uint32_t site_id_ = 0;
+    std::string file_name_;
+    std::string fmt_;
+    std::string text_;
+    bool deferred_ = false;
+};
+}  // namespace
+
+template <>
+struct fmt::formatter<Point> : fmt::formatter<std::string_view> {
+    auto format(const Point& p, fmt::format_context& ctx) const {
+        return fmt::format_to(ctx.out(), "({}, {})", p.x, p.y);
+    }
+};
+
+TEST(LogArgsTest, EncodeAndFormat_Arithmetic) {
+    MemoryBuffer args;
+    detail::EncodeArgs(&args, 42, -7L, 3000000000u, true, 'c', 1.5f, 2.25);
+
+    MemoryBuffer out;
+    ASSERT_TRUE(detail::FormatArgs("{} {} {} {} {} {} {}", args, &out));
+    EXPECT_EQ(out, "42 -7 3000000000 true c 1.5 2.25");
+}
+
+TEST(LogArgsTest, EncodeAndFormat_StringsAndSpecs) {
+    MemoryBuffer args;
+    std::string str = "world";
+    detail::EncodeArgs(&args, "hello", str, std::string_view("view"), 255, 3.14159);
+
+    MemoryBuffer out;
+    ASSERT_TRUE(detail::FormatArgs("{} {:>6} {} {:#x} {:.2f}", args, &out));
+    EXPECT_EQ(out, "hello  world view 0xff 3.14");
+}
+
+TEST(LogArgsTest, EncodeAndFormat_NullString) {
+    MemoryBuffer args;
+    const char* null_str = nullptr;
+    char* null_mut = nullptr;
+    detail::EncodeArgs(&args, null_str, null_mut, "x");
+
+    MemoryBuffer out;
+    ASSERT_TRUE(detail::FormatArgs("{} {} {}", args, &out));
+    EXPECT_EQ(out, "(null) (null) x");
+}
+
+// 格式说明只对原类型有效的参数不走延迟格式化，按调用点的格式说明在调用线程上格式化
+TEST(LogArgsTest, ExtensionHandle_NonDeferrableArgs) {
+    static_assert(!detail::kDeferrableArg<long double>);
+    static_assert(!detail::kDeferrableArg<Point>);
+    static_assert(detail::kDeferrableArgs<int, const char*, std::string>);
+
+    auto sink = std::make_shared<CaptureSink>();
+    ExtensionLogHandle handle(sink);
+    handle.SetDeferredFormat(true);
+
+    handle.Log(LogLevel::kInfo, SourceLocation{}, "v={:.3f} n={:>4}", 1.23456L, 7);
+    EXPECT_FALSE(sink->deferred_);
+    EXPECT_EQ(sink->text_, "v=1.235 n=   7");
+
+    handle.Log(LogLevel::kInfo, SourceLocation{}, "p={} n={:#x}", Point{1, 2}, 255);
+    EXPECT_FALSE(sink->deferred_);
+    EXPECT_EQ(sink->text_, "p=(1, 2) n=0xff");
+
+    handle.Log(LogLevel::kInfo, SourceLocation{}, "v={:.3f}", 1.23456);
+    EXPECT_TRUE(sink->deferred_);
+    EXPECT_EQ(sink->text_, "v=1.235");
+}
+
+TEST(LogArgsTest, Format_CorruptedArgs) {
+    MemoryBuffer args;
+    detail::EncodeArgs(&args, 1, 2);
+    args.resize(args.size() - 3);
+
+    MemoryBuffer out;
+    EXPECT_FALSE(detail::FormatArgs("{} {}", args, &out));
+    EXPECT_TRUE(out.empty());
+}
+
+TEST(LogArgsTest, Format_MismatchedPattern) {
+    MemoryBuffer args;
+    detail::EncodeArgs(&args, 1);
+
+    MemoryBuffer out;
+    EXPECT_FALSE(detail::FormatArgs("{} {}", args, &out));
+    EXPECT_TRUE(out.empty());
+}
+
+TEST(LogArgsTest, ExtensionHandle_DeferredFormat) {
+    auto sink = std::make_shared<CaptureSink>();
+    ExtensionLogHandle handle(sink);
+
+    handle.Log(LogLevel::kInfo, SourceLocation{}, "id={} name={}", 7, "abc");
+    EXPECT_FALSE(sink->deferred_);
+    EXPECT_EQ(sink->text_, "id=7 name=abc");
+
+    handle.SetDeferredFormat(true);
+    handle.Log(LogLevel::kInfo, SourceLocation{}, "id={} name={}", 7, "abc");
+    EXPECT_TRUE(sink->deferred_);
+    EXPECT_EQ(sink->fmt_, "id={} name={}");
+    EXPECT_EQ(sink->text_, "id=7 name=abc");
+}
+
+TEST(LogArgsTest, Macro_StaticSite) {
+    static_assert(SourceBasename("src/a\\b/c.cpp") == "c.cpp");
+    static_assert(SourceBasename("c.cpp") == "c.cpp");
+
+    auto sink = std::make_shared<CaptureSink>();
+    ExtensionLogHandle handle(sink);
+
+    const LogSite* sites[2] = {};
+    for (auto& site : sites) {
+        LOG_LOGGER_INFO(&handle, "value {}", 1);
+        site = sink->site_;
+    }
+    ASSERT_NE(sites[0], nullptr);
+    EXPECT_EQ(sites[0], sites[1]);  // 同一调用点共享同一个描述
+    EXPECT_EQ(sites[0]->location.file_name, "test_log_args.cpp");
+    EXPECT_EQ(sites[0]->level, LogLevel::kInfo);
+    EXPECT_NE(sites[0]->Id(), 0u);
+
+    LOG_LOGGER_WARN(&handle, "value {}", 2);
+    EXPECT_NE(sink->site_, sites[0]);
+    EXPECT_NE(sink->site_->Id(), sites[0]->Id());
+
+    // 手动构造的位置不分配ID
+    handle.Log(LogLevel::kInfo, SourceLocation{__FILE__, __LINE__, __FUNCTION__}, "value {}", 3);
+    EXPECT_EQ(sink->site_id_, 0u);
+    EXPECT_EQ(sink->file_name_, "test_log_args.cpp");
+}
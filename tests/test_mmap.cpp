@@ -1,4 +1,7 @@
 #include <gtest/gtest.h>
+#include <atomic>
+#include <chrono>
+#include <thread>
 #include <vector>
 #include <cstring>
 #include <filesystem>
@@ -6,6 +9,7 @@
 
 #include "internal_log.h"
 #include "mmap/mmap_handle.h"
+#include "utils/sys_util.h"
 
 using namespace logger;
 
@@ -222,6 +226,317 @@ TEST_F(MMapHandleTest, FilePersistence) {
     }
 }
 
+TEST_F(MMapHandleTest, MetaPersistence) {
+    // 元数据随文件持久化，Clear 只清数据不清元数据
+    const char meta[] = "chunk meta";
+    {
+        MMapHandle mmap(test_file_);
+        ASSERT_NE(mmap.Meta(), nullptr);
+        memcpy(mmap.Meta(), meta, sizeof(meta));
+        EXPECT_TRUE(mmap.Push(meta, sizeof(meta)));
+        mmap.Clear();
+    }
+
+    {
+        MMapHandle mmap(test_file_);
+        EXPECT_TRUE(mmap.Empty());
+        EXPECT_EQ(std::memcmp(mmap.Meta(), meta, sizeof(meta)), 0);
+    }
+}
+
+TEST_F(MMapHandleTest, InitialCapacity) {
+    // 缓存段按指定大小映射，已有文件更大时按文件大小映射
+    constexpr size_t kCapacity = 64 * 1024;
+    {
+        MMapHandle mmap(test_file_, kCapacity);
+        EXPECT_EQ(mmap.Capacity(), kCapacity);
+
+        std::vector<uint8_t> data(kCapacity, 0x5a);
+        EXPECT_TRUE(mmap.Push(data.data(), data.size()));
+        EXPECT_GT(mmap.Capacity(), kCapacity);
+    }
+
+    {
+        MMapHandle mmap(test_file_, kCapacity);
+        EXPECT_GT(mmap.Capacity(), kCapacity);
+        EXPECT_EQ(mmap.Size(), kCapacity);
+    }
+}
+
+TEST_F(MMapHandleTest, GrowthFactor) {
+    // 容量翻倍；一次写入需要的更多时只扩到所需大小 (按页取整)，不再额外加上原容量
+    constexpr size_t kCapacity = 64 * 1024;
+    MMapHandle mmap(test_file_, kCapacity);
+    std::vector<uint8_t> small(kCapacity / 2, 0x11);
+    ASSERT_TRUE(mmap.Push(small.data(), small.size()));
+    ASSERT_TRUE(mmap.Push(small.data(), small.size()));
+    EXPECT_EQ(mmap.Capacity(), 2 * kCapacity);
+
+    std::vector<uint8_t> large(5 * kCapacity, 0x22);
+    size_t need = mmap.Size() + large.size();
+    ASSERT_TRUE(mmap.Push(large.data(), large.size()));
+    EXPECT_GE(mmap.Capacity(), need);
+    EXPECT_LT(mmap.Capacity(), need + kCapacity);
+}
+
+TEST_F(MMapHandleTest, GrowKeepsData) {
+    // 预留范围内扩容地址不变，超出预留范围后按 mremap 扩容，已写入的数据都保留
+    constexpr size_t kCapacity = 64 * 1024;
+    MMapHandle mmap(test_file_, kCapacity, 4 * kCapacity);
+    uint8_t* base = mmap.Data();
+
+    std::vector<uint8_t> data(kCapacity);
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    ASSERT_TRUE(mmap.Push(data.data(), data.size()));
+    EXPECT_EQ(mmap.Data(), base);
+
+    for (int i = 0; i < 4; ++i) {
+        ASSERT_TRUE(mmap.Push(data.data(), data.size()));
+    }
+    EXPECT_GT(mmap.Capacity(), 4 * kCapacity);
+    for (size_t offset = 0; offset < mmap.Size(); offset += data.size()) {
+        EXPECT_EQ(std::memcmp(mmap.Data() + offset, data.data(), data.size()), 0);
+    }
+    EXPECT_GE(std::filesystem::file_size(test_file_), mmap.Capacity());
+}
+
+TEST_F(MMapHandleTest, PushVAndReserve) {
+    MMapHandle mmap(test_file_);
+    std::string head = "head:";
+    std::string body = "payload";
+    MMapHandle::Span spans[] = {{head.data(), head.size()}, {nullptr, 0}, {body.data(), body.size()}};
+    ASSERT_TRUE(mmap.PushV(spans, 3));
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(mmap.Data()), mmap.Size()), head + body);
+
+    // 预留的空间在 Advance 之前不计入数据，只发布实际写入的部分
+    uint8_t* dest = mmap.Reserve(mmap.Capacity());
+    ASSERT_NE(dest, nullptr);
+    EXPECT_EQ(mmap.Size(), head.size() + body.size());
+    memcpy(dest, "tail", 4);
+    mmap.Advance(4);
+    EXPECT_TRUE(mmap.Committed());
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(mmap.Data()), mmap.Size()), head + body + "tail");
+}
+
+TEST_F(MMapHandleTest, PopulateAndHugePages) {
+    // 大页选项下容量按大页对齐，文件系统不支持大页时退化为普通页，读写不受影响
+    MMapHandle::Options options;
+    options.capacity = 64 * 1024;
+    options.populate = true;
+    options.huge_pages = true;
+    MMapHandle mmap(test_file_, options);
+
+    EXPECT_EQ(mmap.Capacity() % MMapHandle::kHugePageSize, 0);
+    EXPECT_TRUE(mmap.Empty());
+
+    std::vector<uint8_t> data(3 * 1024 * 1024, 0x3c);
+    ASSERT_TRUE(mmap.Push(data.data(), data.size()));
+    EXPECT_EQ(mmap.Capacity() % MMapHandle::kHugePageSize, 0);
+    EXPECT_EQ(std::memcmp(mmap.Data(), data.data(), data.size()), 0);
+}
+
+TEST_F(MMapHandleTest, Reallocate) {
+    // 扩大和缩小映射容量，缩小不会低于已有数据，文件大小随之调整
+    constexpr size_t kCapacity = 64 * 1024;
+    MMapHandle mmap(test_file_, kCapacity, 16 * kCapacity);
+    std::string data = "keep me";
+    ASSERT_TRUE(mmap.Push(data.data(), data.size()));
+
+    ASSERT_TRUE(mmap.Reallocate(8 * kCapacity));
+    EXPECT_EQ(mmap.Capacity(), 8 * kCapacity);
+    std::vector<uint8_t> fill(6 * kCapacity, 0x11);
+    ASSERT_TRUE(mmap.Push(fill.data(), fill.size()));
+    EXPECT_EQ(mmap.Capacity(), 8 * kCapacity);
+
+    EXPECT_TRUE(mmap.Reallocate(kCapacity));
+    EXPECT_GE(mmap.Capacity(), mmap.Size());
+
+    mmap.Resize(data.size());
+    ASSERT_TRUE(mmap.Reallocate(kCapacity));
+    EXPECT_EQ(mmap.Capacity(), kCapacity);
+    EXPECT_EQ(std::filesystem::file_size(test_file_), kCapacity);
+    EXPECT_EQ(std::string(reinterpret_cast<char*>(mmap.Data()), mmap.Size()), data);
+
+    // 缩小后仍可以在预留范围内再次扩容
+    ASSERT_TRUE(mmap.Push(fill.data(), fill.size()));
+    EXPECT_EQ(std::memcmp(mmap.Data(), data.data(), data.size()), 0);
+}
+
+TEST_F(MMapHandleTest, ConcurrentClaim) {
+    // 多个写者同时预留并写入，每条记录 [thread:4][seq:4] 不重叠，全部提交后数量完整
+    constexpr size_t kCapacity = 1024 * 1024;
+    constexpr uint32_t kThreads = 4;
+    constexpr uint32_t kPerThread = 10000;
+    MMapHandle mmap(test_file_, kCapacity);
+
+    std::vector<std::thread> writers;
+    for (uint32_t t = 0; t < kThreads; ++t) {
+        writers.emplace_back([&mmap, t]() {
+            for (uint32_t i = 0; i < kPerThread; ++i) {
+                uint32_t record[2] = {t, i};
+                uint8_t* dest = mmap.Claim(sizeof(record));
+                ASSERT_NE(dest, nullptr);
+                memcpy(dest, record, sizeof(record));
+                mmap.Commit(dest, sizeof(record));
+            }
+        });
+    }
+    for (auto& writer : writers) {
+        writer.join();
+    }
+
+    ASSERT_TRUE(mmap.Committed());
+    ASSERT_EQ(mmap.Size(), kThreads * kPerThread * 8);
+    std::vector<uint32_t> next(kThreads, 0);
+    for (size_t offset = 0; offset < mmap.Size(); offset += 8) {
+        uint32_t record[2];
+        memcpy(record, mmap.Data() + offset, sizeof(record));
+        ASSERT_LT(record[0], kThreads);
+        EXPECT_EQ(record[1], next[record[0]]++);  // 同一写者内有序
+    }
+}
+
+TEST_F(MMapHandleTest, CommitInClaimOrder) {
+    // 后预留的先写完时要等前面的提交，已提交的部分始终是连续的前缀
+    MMapHandle mmap(test_file_);
+    uint8_t* first = mmap.Claim(8);
+    uint8_t* second = mmap.Claim(8);
+    ASSERT_NE(first, nullptr);
+    ASSERT_NE(second, nullptr);
+
+    std::atomic<bool> done{false};
+    std::thread writer([&]() {
+        memcpy(second, "second!!", 8);
+        mmap.Commit(second, 8);
+        done = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    EXPECT_FALSE(done);
+    EXPECT_FALSE(mmap.Committed());
+
+    memcpy(first, "first!!!", 8);
+    mmap.Commit(first, 8);
+    writer.join();
+    EXPECT_TRUE(done);
+    EXPECT_TRUE(mmap.Committed());
+    EXPECT_EQ(memcmp(mmap.Data(), "first!!!second!!", 16), 0);
+}
+
+TEST_F(MMapHandleTest, ClaimWithinCapacity) {
+    // 预留不扩容，空间不足返回空，且不影响已有数据
+    constexpr size_t kCapacity = 64 * 1024;
+    MMapHandle mmap(test_file_, kCapacity);
+
+    uint8_t* dest = mmap.Claim(16);
+    ASSERT_NE(dest, nullptr);
+    EXPECT_FALSE(mmap.Committed());
+    mmap.Commit(dest, 16);
+    EXPECT_TRUE(mmap.Committed());
+
+    EXPECT_EQ(mmap.Claim(kCapacity), nullptr);
+    EXPECT_EQ(mmap.Size(), 16);
+    EXPECT_EQ(mmap.Capacity(), kCapacity);
+}
+
+TEST_F(MMapHandleTest, CopyFileRange) {
+    // 映射中写入的数据通过描述符直接拷贝到另一个文件，追加在已有内容之后
+    MMapHandle mmap(test_file_);
+    std::string data(100 * 1024, 'x');
+    for (size_t i = 0; i < data.size(); ++i) {
+        data[i] = static_cast<char>(i % 251);
+    }
+    ASSERT_TRUE(mmap.Push(data.data(), data.size()));
+
+    auto out_file = test_file_;
+    out_file += ".out";
+    int fd = OpenAppendFile(out_file);
+    ASSERT_NE(fd, -1);
+    ASSERT_TRUE(WriteFile(fd, "head", 4));
+    ASSERT_TRUE(CopyFileRange(mmap.Fd(), MMapHandle::DataOffset(), fd, mmap.Size()));
+    CloseFile(fd);
+
+    std::ifstream ifs(out_file, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    EXPECT_EQ(content, "head" + data);
+    std::filesystem::remove(out_file);
+}
+
+TEST_F(MMapHandleTest, SyncDirty) {
+    // 只同步上次之后追加的数据，发起回写和等待落盘分别记录
+    MMapHandle mmap(test_file_);
+    std::string data(10000, 'a');
+    ASSERT_TRUE(mmap.Push(data.data(), data.size()));
+    EXPECT_TRUE(mmap.Sync(mmap.Size(), false));
+    EXPECT_TRUE(mmap.Sync(mmap.Size(), false));
+    EXPECT_TRUE(mmap.Sync(mmap.Size(), true));
+
+    ASSERT_TRUE(mmap.Push(data.data(), data.size()));
+    EXPECT_TRUE(mmap.Sync(mmap.Size(), true));
+
+    // 清空后从头开始记录
+    mmap.Clear();
+    ASSERT_TRUE(mmap.Push(data.data(), 100));
+    EXPECT_TRUE(mmap.Sync(mmap.Size(), true));
+
+    MMapHandle reopened(test_file_);
+    EXPECT_EQ(reopened.Size(), 100);
+}
+
+TEST_F(MMapHandleTest, SealOnCrash) {
+    // 崩溃时丢弃未提交的部分，在已提交的数据后追加记录并标记封存
+    {
+        MMapHandle mmap(test_file_);
+        ASSERT_TRUE(mmap.Push("committed", 9));
+        uint8_t* torn = mmap.Claim(100);
+        ASSERT_NE(torn, nullptr);
+        memset(torn, 'x', 50);
+        EXPECT_FALSE(mmap.Sealed());
+
+        mmap.SealOnCrash("tail", 4);
+        EXPECT_TRUE(mmap.Sealed());
+        EXPECT_TRUE(mmap.Committed());
+        ASSERT_EQ(mmap.Size(), 13);
+        EXPECT_EQ(memcmp(mmap.Data(), "committedtail", 13), 0);
+    }
+
+    // 封存标记随文件保留，清空后清除
+    MMapHandle reopened(test_file_);
+    EXPECT_TRUE(reopened.Sealed());
+    EXPECT_EQ(reopened.Size(), 13);
+    reopened.Clear();
+    EXPECT_FALSE(reopened.Sealed());
+
+    // 空间不够时只封存不追加
+    MMapHandle small(test_file_);
+    size_t free_space = small.Capacity() - MMapHandle::DataOffset();
+    std::string data(free_space - 2, 'a');
+    ASSERT_TRUE(small.Push(data.data(), data.size()));
+    small.SealOnCrash("tail", 4);
+    EXPECT_TRUE(small.Sealed());
+    EXPECT_EQ(small.Size(), data.size());
+}
+
+TEST_F(MMapHandleTest, Recognized) {
+    EXPECT_TRUE(MMapHandle::Recognized(test_file_));  // 不存在
+
+    {
+        MMapHandle mmap(test_file_);
+        ASSERT_TRUE(mmap.Push("data", 4));
+    }
+    EXPECT_TRUE(MMapHandle::Recognized(test_file_));
+
+    // 旧版本的缓存：16字节文件头，魔数 0xdeadbeef
+    {
+        std::ofstream ofs(test_file_, std::ios::binary | std::ios::trunc);
+        uint32_t legacy[4] = {0xdeadbeef, 0, 4, 0};
+        ofs.write(reinterpret_cast<const char*>(legacy), sizeof(legacy));
+        ofs.write("data", 4);
+    }
+    EXPECT_FALSE(MMapHandle::Recognized(test_file_));
+}
+
 // 死亡测试：测试无效参数
 TEST_F(MMapHandleTest, InvalidParameters) {
     MMapHandle mmap(test_file_);
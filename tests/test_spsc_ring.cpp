@@ -0,0 +1,139 @@
+#include <gtest/gtest.h>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "context/spsc_ring.h"
+
+using namespace logger;
+
+static bool PushString(SpscRing& ring, const std::string& str) {
+    void* dest = ring.Reserve(str.size());
+    if (!dest) {
+        return false;
+    }
+    memcpy(dest, str.data(), str.size());
+    ring.Commit();
+    return true;
+}
+
+TEST(SpscRingTest, PushAndConsume) {
+    SpscRing ring(1024);
+    EXPECT_TRUE(ring.Empty());
+    EXPECT_EQ(ring.Capacity(), 1024u);
+
+    ASSERT_TRUE(PushString(ring, "hello"));
+    ASSERT_TRUE(PushString(ring, "ring"));
+    EXPECT_FALSE(ring.Empty());
+
+    std::vector<std::string> out;
+    size_t count = ring.Consume(
+            [&out](const uint8_t* data, uint32_t size) { out.emplace_back(reinterpret_cast<const char*>(data), size); });
+
+    EXPECT_EQ(count, 2u);
+    ASSERT_EQ(out.size(), 2u);
+    EXPECT_EQ(out[0], "hello");
+    EXPECT_EQ(out[1], "ring");
+    EXPECT_TRUE(ring.Empty());
+}
+
+TEST(SpscRingTest, UncommittedIsInvisible) {
+    SpscRing ring(256);
+    void* dest = ring.Reserve(4);
+    ASSERT_NE(dest, nullptr);
+    memcpy(dest, "abcd", 4);
+
+    size_t count = ring.Consume([](const uint8_t*, uint32_t) {});
+    EXPECT_EQ(count, 0u);
+
+    ring.Commit();
+    count = ring.Consume([](const uint8_t*, uint32_t) {});
+    EXPECT_EQ(count, 1u);
+}
+
+TEST(SpscRingTest, CommitHighWater) {
+    // 每条记录占 64 字节，已用空间到容量一半时提示唤醒，消费者没跟上时每 1/8 容量再提示一次
+    SpscRing ring(1024);
+    std::string record(56, 'r');
+    auto push = [&ring, &record]() {
+        void* dest = ring.Reserve(record.size());
+        EXPECT_NE(dest, nullptr);
+        memcpy(dest, record.data(), record.size());
+        return ring.Commit();
+    };
+
+    for (int i = 1; i < 8; ++i) {
+        EXPECT_FALSE(push()) << i;
+    }
+    EXPECT_TRUE(push());
+    EXPECT_FALSE(push());
+    EXPECT_TRUE(push());
+
+    // 排空后重新从低水位开始
+    EXPECT_EQ(ring.Consume([](const uint8_t*, uint32_t) {}), 10u);
+    for (int i = 1; i < 8; ++i) {
+        EXPECT_FALSE(push()) << i;
+    }
+    EXPECT_TRUE(push());
+}
+
+TEST(SpscRingTest, FullAndWrapAround) {
+    SpscRing ring(256);
+    std::string record(40, 'x');
+
+    // 写满后再写入失败
+    size_t pushed = 0;
+    while (PushString(ring, record)) {
+        ++pushed;
+    }
+    EXPECT_GT(pushed, 0u);
+    EXPECT_FALSE(ring.Fits(200));
+
+    // 消费后空间回收，多轮写入会跨越环尾
+    for (int round = 0; round < 10; ++round) {
+        ring.Consume([](const uint8_t*, uint32_t) {});
+        for (int i = 0; i < 3; ++i) {
+            std::string str = std::to_string(round) + "_" + std::to_string(i) + std::string(round * 3, 'y');
+            ASSERT_TRUE(PushString(ring, str));
+        }
+        std::vector<std::string> out;
+        ring.Consume([&out](const uint8_t* data, uint32_t size) {
+            out.emplace_back(reinterpret_cast<const char*>(data), size);
+        });
+        ASSERT_EQ(out.size(), 3u);
+        EXPECT_EQ(out[2].substr(0, out[2].find('_')), std::to_string(round));
+    }
+}
+
+TEST(SpscRingTest, ConcurrentProducerConsumer) {
+    SpscRing ring(4096);
+    constexpr uint32_t kCount = 20000;
+
+    std::thread producer([&ring]() {
+        for (uint32_t i = 0; i < kCount; ++i) {
+            uint32_t size = sizeof(uint32_t) + (i % 50);
+            void* dest = nullptr;
+            while (!(dest = ring.Reserve(size))) {
+                std::this_thread::yield();
+            }
+            memcpy(dest, &i, sizeof(i));
+            ring.Commit();
+        }
+    });
+
+    uint32_t expect = 0;
+    bool ordered = true;
+    while (expect < kCount) {
+        ring.Consume([&](const uint8_t* data, uint32_t size) {
+            uint32_t value = 0;
+            memcpy(&value, data, sizeof(value));
+            ordered = ordered && value == expect && size == sizeof(uint32_t) + (value % 50);
+            ++expect;
+        });
+    }
+    producer.join();
+
+    EXPECT_TRUE(ordered);
+    EXPECT_TRUE(ring.Empty());
+}
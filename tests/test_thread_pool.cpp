@@ -213,6 +213,54 @@ TEST_F(ThreadPoolTest, MoveOnlyTypes) {
     EXPECT_EQ(*result, 123);
 }
 
+TEST_F(ThreadPoolTest, StopDrainsQueuedTasks) {
+    ThreadPool pool(1);
+    pool.Start();
+    std::atomic<int> counter{0};
+
+    // 单线程，停止时大部分任务还在排队
+    for (int i = 0; i < 50; ++i) {
+        pool.Submit([&counter]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            counter++;
+        });
+    }
+    pool.Stop();
+
+    EXPECT_EQ(counter, 50);
+}
+
+TEST_F(ThreadPoolTest, StopRunsFollowUpTasks) {
+    ThreadPool pool(1);
+    pool.Start();
+    std::atomic<int> counter{0};
+
+    // 停止时排队的任务再提交的后续任务也会执行
+    for (int i = 0; i < 10; ++i) {
+        pool.Submit([&pool, &counter]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            pool.Submit([&counter]() { counter++; });
+        });
+    }
+    pool.Stop();
+
+    EXPECT_EQ(counter, 10);
+    EXPECT_THROW(pool.Submit([]() {}), std::runtime_error);
+}
+
+TEST_F(ThreadPoolTest, TaskExceptionCaught) {
+    ThreadPool pool(1);
+    pool.Start();
+    std::atomic<int> counter{0};
+
+    pool.Submit([]() { throw std::runtime_error("task failed"); });
+    pool.Submit([&counter]() { counter++; });
+    pool.Stop();
+
+    // 异常留在工作线程中，后面的任务照常执行
+    EXPECT_EQ(counter, 1);
+}
+
 // 性能测试（可选，使用 DISABLED_ 前缀可以暂时禁用）
 TEST_F(ThreadPoolTest, DISABLED_PerformanceComparison) {
     const int num_tasks = 10000;